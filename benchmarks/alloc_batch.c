@@ -0,0 +1,64 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+
+// Allocates and frees rounds of same-sized objects, once with a loop of
+// fstd_alloc/fstd_free and once with fstd_alloc_batch/fstd_free_batch, and
+// reports the time per object for each.
+
+#define BATCH_COUNT 4096
+#define ROUND_COUNT 512
+
+static void run(size_t size, int batched) {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1 << 20);
+
+  void **ptrs = malloc(sizeof(void *) * BATCH_COUNT);
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+  uint64_t start = bench_now_ns();
+  for (size_t round = 0; round < ROUND_COUNT; round++) {
+    if (batched) {
+      fstd_alloc_batch(&allocator, size, BATCH_COUNT, ptrs);
+    } else {
+      for (size_t i = 0; i < BATCH_COUNT; i++) {
+        ptrs[i] = fstd_alloc(&allocator, size);
+      }
+    }
+
+    // Free in a random order so neighbours don't get freed one after another
+    for (size_t i = BATCH_COUNT - 1; i > 0; i--) {
+      size_t j = bench_rand(&rng) % (i + 1);
+      void *ptr = ptrs[i];
+      ptrs[i] = ptrs[j];
+      ptrs[j] = ptr;
+    }
+
+    if (batched) {
+      fstd_free_batch(&allocator, ptrs, BATCH_COUNT);
+    } else {
+      for (size_t i = 0; i < BATCH_COUNT; i++) {
+        fstd_free(&allocator, ptrs[i]);
+      }
+    }
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  printf(
+      "size %4zu  %-7s ns/object %6.2f\n",
+      size,
+      batched ? "batch" : "loop",
+      (double)elapsed / (double)(ROUND_COUNT * BATCH_COUNT));
+
+  free(ptrs);
+  fstd_allocator_destroy(&allocator);
+}
+
+int main() {
+  size_t sizes[] = {16, 64, 256};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    run(sizes[i], 0);
+    run(sizes[i], 1);
+  }
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+
+// Per-call latency of fstd_alloc/fstd_free for each fit policy on a heap with
+// many live allocations of random sizes, and the footprint and fragmentation
+// (how much of the free space is not in the largest free chunk) it ends with.
+
+#define LIVE_COUNT 20000
+#define OP_COUNT 1000000
+
+static void run(const char *name, fstd_alloc_fit_t fit) {
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 20;
+  options.fit = fit;
+
+  fstd_allocator_t allocator;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  void **live = calloc(LIVE_COUNT, sizeof(void *));
+  uint64_t *samples = malloc(sizeof(uint64_t) * OP_COUNT);
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+  for (size_t i = 0; i < LIVE_COUNT; i++) {
+    live[i] = fstd_alloc(&allocator, 16 + bench_rand(&rng) % 1024);
+  }
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < OP_COUNT; i++) {
+    size_t slot = bench_rand(&rng) % LIVE_COUNT;
+    size_t size = 16 + bench_rand(&rng) % 1024;
+    if (bench_rand(&rng) % 16 == 0) {
+      size += bench_rand(&rng) % (64 << 10);
+    }
+
+    uint64_t start = bench_now_ns();
+    fstd_free(&allocator, live[slot]);
+    live[slot] = fstd_alloc(&allocator, size);
+    uint64_t elapsed = bench_now_ns() - start;
+
+    samples[i] = elapsed;
+    total += elapsed;
+  }
+
+  bench_sort(samples, OP_COUNT);
+  printf(
+      "%-6s free+alloc ns: mean %6.1f  p50 %5llu  p99 %6llu  p999 %7llu  "
+      "max %8llu\n",
+      name,
+      (double)total / OP_COUNT,
+      (unsigned long long)bench_percentile(samples, OP_COUNT, 50.0),
+      (unsigned long long)bench_percentile(samples, OP_COUNT, 99.0),
+      (unsigned long long)bench_percentile(samples, OP_COUNT, 99.9),
+      (unsigned long long)samples[OP_COUNT - 1]);
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  printf(
+      "%-6s blocks %4zu  live/block bytes %5.1f%%  fragmentation %5.1f%%\n",
+      "",
+      stats.block_count,
+      100.0 *
+          (double)(stats.block_bytes - stats.free_bytes -
+                   stats.overhead_bytes) /
+          (double)stats.block_bytes,
+      stats.free_bytes == 0
+          ? 0.0
+          : 100.0 - 100.0 * (double)stats.largest_free /
+                        (double)stats.free_bytes);
+
+  free(samples);
+  free(live);
+  fstd_allocator_destroy(&allocator);
+}
+
+int main() {
+  run("first", FSTD_ALLOC_FIT_FIRST);
+  run("next", FSTD_ALLOC_FIT_NEXT);
+  run("best", FSTD_ALLOC_FIT_BEST);
+  run("tlsf", FSTD_ALLOC_FIT_TLSF);
+  return 0;
+}
@@ -0,0 +1,495 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Replays an allocation trace recorded with fstd_allocator_trace against
+// every fit policy of fstd_allocator_t, aligned blocks, fstd_heap_t and libc
+// malloc. Each one runs in its own process so their peak RSS can be
+// compared. Reports throughput, per-call latency percentiles and peak RSS
+// (above what the process used before replaying).
+//
+//   alloc_replay [trace file]
+//
+// Without a trace file, a synthetic one with reallocs and a few big
+// allocations is replayed instead.
+
+#define SYNTHETIC_OP_COUNT 1000000
+#define SYNTHETIC_LIVE_COUNT 20000
+
+// A trace record where pointers were replaced by slots, which are reused
+// once their allocation is freed so they stay few
+typedef struct op_t {
+  fstd_alloc_trace_op_t kind;
+  uint32_t slot;
+  size_t size;
+  size_t align;
+} op_t;
+
+typedef struct trace_t {
+  op_t *ops;
+  size_t op_count;
+  size_t op_capacity;
+  size_t slot_count;
+  size_t alloc_count;
+  size_t realloc_count;
+  size_t free_count;
+  uint64_t duration; // Nanoseconds the recording took
+} trace_t;
+
+static op_t *trace_push(trace_t *trace) {
+  if (trace->op_count == trace->op_capacity) {
+    trace->op_capacity =
+        trace->op_capacity == 0 ? 1024 : trace->op_capacity * 2;
+    trace->ops = realloc(trace->ops, sizeof(op_t) * trace->op_capacity);
+  }
+  return &trace->ops[trace->op_count++];
+}
+
+// Address to slot, with linear probing. Addresses are never 0, so 0 marks
+// an empty entry.
+typedef struct slot_map_t {
+  uint64_t *addresses;
+  uint32_t *slots;
+  size_t capacity;
+  size_t count;
+} slot_map_t;
+
+static size_t slot_map_index(slot_map_t *map, uint64_t address) {
+  return (size_t)(((address >> 4) * 0x9E3779B97F4A7C15ull) >> 32) &
+         (map->capacity - 1);
+}
+
+static void slot_map_set(slot_map_t *map, uint64_t address, uint32_t slot);
+
+static void slot_map_grow(slot_map_t *map) {
+  slot_map_t old = *map;
+  map->capacity = old.capacity == 0 ? 1024 : old.capacity * 2;
+  map->count = 0;
+  map->addresses = calloc(map->capacity, sizeof(uint64_t));
+  map->slots = calloc(map->capacity, sizeof(uint32_t));
+
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (old.addresses[i] != 0) {
+      slot_map_set(map, old.addresses[i], old.slots[i]);
+    }
+  }
+  free(old.addresses);
+  free(old.slots);
+}
+
+static void slot_map_set(slot_map_t *map, uint64_t address, uint32_t slot) {
+  if ((map->count + 1) * 2 > map->capacity) {
+    slot_map_grow(map);
+  }
+
+  size_t index = slot_map_index(map, address);
+  while (map->addresses[index] != 0 && map->addresses[index] != address) {
+    index = (index + 1) & (map->capacity - 1);
+  }
+  if (map->addresses[index] == 0) {
+    map->count++;
+  }
+  map->addresses[index] = address;
+  map->slots[index] = slot;
+}
+
+// Removes `address` and returns its slot, or UINT32_MAX if it isn't there
+static uint32_t slot_map_take(slot_map_t *map, uint64_t address) {
+  if (map->capacity == 0) {
+    return UINT32_MAX;
+  }
+
+  size_t index = slot_map_index(map, address);
+  while (map->addresses[index] != address) {
+    if (map->addresses[index] == 0) {
+      return UINT32_MAX;
+    }
+    index = (index + 1) & (map->capacity - 1);
+  }
+  uint32_t slot = map->slots[index];
+
+  // Shift back the entries after it that would no longer be found
+  size_t hole = index;
+  for (;;) {
+    index = (index + 1) & (map->capacity - 1);
+    if (map->addresses[index] == 0) {
+      break;
+    }
+    size_t home = slot_map_index(map, map->addresses[index]);
+    if (((index - home) & (map->capacity - 1)) >=
+        ((index - hole) & (map->capacity - 1))) {
+      map->addresses[hole] = map->addresses[index];
+      map->slots[hole] = map->slots[index];
+      hole = index;
+    }
+  }
+  map->addresses[hole] = 0;
+  map->count--;
+
+  return slot;
+}
+
+static uint32_t *free_slots;
+static size_t free_slot_count;
+static size_t free_slot_capacity;
+
+static uint32_t slot_acquire(trace_t *trace) {
+  if (free_slot_count > 0) {
+    return free_slots[--free_slot_count];
+  }
+  return (uint32_t)trace->slot_count++;
+}
+
+static void slot_release(uint32_t slot) {
+  if (free_slot_count == free_slot_capacity) {
+    free_slot_capacity =
+        free_slot_capacity == 0 ? 1024 : free_slot_capacity * 2;
+    free_slots = realloc(free_slots, sizeof(uint32_t) * free_slot_capacity);
+  }
+  free_slots[free_slot_count++] = slot;
+}
+
+static bool trace_load(trace_t *trace, const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "can't open %s\n", path);
+    return false;
+  }
+
+  fseek(file, 0, SEEK_END);
+  long file_size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *data = malloc((size_t)file_size);
+  size_t size = fread(data, 1, (size_t)file_size, file);
+  fclose(file);
+
+  if (size < FSTD_ALLOC_TRACE_MAGIC_SIZE ||
+      memcmp(data, FSTD_ALLOC_TRACE_MAGIC, FSTD_ALLOC_TRACE_MAGIC_SIZE) != 0) {
+    fprintf(stderr, "%s is not an allocation trace\n", path);
+    free(data);
+    return false;
+  }
+
+  slot_map_t map = {0};
+  const uint8_t *cursor = data + FSTD_ALLOC_TRACE_MAGIC_SIZE;
+  fstd_alloc_trace_record_t record;
+  while (fstd_alloc_trace_read(&cursor, data + size, &record)) {
+    trace->duration += record.time;
+
+    // Memory allocated before the recording started can't be replayed, so
+    // its frees are dropped and its reallocs become allocations
+    uint32_t slot = UINT32_MAX;
+    if (record.op != FSTD_ALLOC_TRACE_ALLOC && record.old_ptr != 0) {
+      slot = slot_map_take(&map, record.old_ptr);
+    } else if (record.op == FSTD_ALLOC_TRACE_FREE) {
+      slot = slot_map_take(&map, record.ptr);
+    }
+
+    if (record.op == FSTD_ALLOC_TRACE_FREE) {
+      if (slot == UINT32_MAX) {
+        continue;
+      }
+      slot_release(slot);
+      trace->free_count++;
+    } else {
+      if (slot == UINT32_MAX) {
+        slot = slot_acquire(trace);
+        record.op = FSTD_ALLOC_TRACE_ALLOC;
+      }
+      slot_map_set(&map, record.ptr, slot);
+      if (record.op == FSTD_ALLOC_TRACE_ALLOC) {
+        trace->alloc_count++;
+      } else {
+        trace->realloc_count++;
+      }
+    }
+
+    op_t *op = trace_push(trace);
+    op->kind = record.op;
+    op->slot = slot;
+    op->size = (size_t)record.size;
+    op->align = (size_t)record.align;
+  }
+
+  if (cursor != data + size) {
+    fprintf(stderr, "%s is cut short, replaying what was read\n", path);
+  }
+
+  free(map.addresses);
+  free(map.slots);
+  free(data);
+  return true;
+}
+
+// Mostly small objects, some of them growing with realloc, and a few big
+// ones
+static void trace_synthesize(trace_t *trace) {
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+  size_t *sizes = calloc(SYNTHETIC_LIVE_COUNT, sizeof(size_t));
+  trace->slot_count = SYNTHETIC_LIVE_COUNT;
+
+  for (size_t i = 0; i < SYNTHETIC_OP_COUNT; i++) {
+    uint32_t slot = (uint32_t)(bench_rand(&rng) % SYNTHETIC_LIVE_COUNT);
+    op_t *op = trace_push(trace);
+    op->slot = slot;
+    op->align = 16;
+
+    if (sizes[slot] == 0) {
+      op->kind = FSTD_ALLOC_TRACE_ALLOC;
+      op->size = (size_t)16 << (bench_rand(&rng) % 7);
+      op->size += bench_rand(&rng) % op->size;
+      if (bench_rand(&rng) % 256 == 0) {
+        op->size = (size_t)(64 << 10) + bench_rand(&rng) % (1 << 20);
+      }
+      sizes[slot] = op->size;
+      trace->alloc_count++;
+    } else if (bench_rand(&rng) % 4 == 0 && sizes[slot] < (64 << 10)) {
+      op->kind = FSTD_ALLOC_TRACE_REALLOC;
+      op->size = sizes[slot] * 2;
+      sizes[slot] = op->size;
+      trace->realloc_count++;
+    } else {
+      op->kind = FSTD_ALLOC_TRACE_FREE;
+      sizes[slot] = 0;
+      trace->free_count++;
+    }
+  }
+
+  free(sizes);
+}
+
+typedef enum target_kind_t {
+  TARGET_ALLOCATOR,
+  TARGET_HEAP,
+  TARGET_LIBC,
+} target_kind_t;
+
+typedef struct target_t {
+  const char *name;
+  target_kind_t kind;
+  fstd_alloc_fit_t fit;
+  bool aligned_blocks;
+  fstd_allocator_t allocator;
+  fstd_heap_t heap;
+} target_t;
+
+static void *target_alloc(target_t *target, size_t size, size_t align) {
+  switch (target->kind) {
+  case TARGET_ALLOCATOR:
+    return fstd_alloc_aligned(&target->allocator, size, align);
+  case TARGET_HEAP:
+    return align <= 16
+               ? fstd_heap_alloc(&target->heap, size)
+               : fstd_alloc_aligned(&target->heap.allocator, size, align);
+  case TARGET_LIBC:
+  default:
+    if (align <= 16) {
+      return malloc(size);
+    }
+    void *ptr = NULL;
+    return posix_memalign(&ptr, align, size) == 0 ? ptr : NULL;
+  }
+}
+
+static void *target_realloc(
+    target_t *target, void *ptr, size_t old_size, size_t size, size_t align) {
+  switch (target->kind) {
+  case TARGET_ALLOCATOR:
+    return fstd_realloc_aligned(&target->allocator, ptr, size, align);
+  case TARGET_HEAP:
+    if (align <= 16) {
+      return fstd_heap_realloc(&target->heap, ptr, size);
+    }
+    return fstd_realloc_aligned(&target->heap.allocator, ptr, size, align);
+  case TARGET_LIBC:
+  default:
+    if (align <= 16) {
+      return realloc(ptr, size);
+    }
+    void *new_ptr = target_alloc(target, size, align);
+    if (ptr != NULL) {
+      memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+      free(ptr);
+    }
+    return new_ptr;
+  }
+}
+
+static void target_free(target_t *target, void *ptr) {
+  switch (target->kind) {
+  case TARGET_ALLOCATOR:
+    fstd_free(&target->allocator, ptr);
+    break;
+  case TARGET_HEAP:
+    fstd_heap_free(&target->heap, ptr);
+    break;
+  case TARGET_LIBC:
+  default:
+    free(ptr);
+    break;
+  }
+}
+
+// Returns the total nanoseconds spent, filling `samples` with the time of
+// each call when it isn't NULL
+static uint64_t replay(
+    target_t *target,
+    const trace_t *trace,
+    void **ptrs,
+    size_t *sizes,
+    uint64_t *samples) {
+  uint64_t total = 0;
+  uint64_t start = bench_now_ns();
+
+  for (size_t i = 0; i < trace->op_count; i++) {
+    const op_t *op = &trace->ops[i];
+    uint64_t op_start = samples != NULL ? bench_now_ns() : 0;
+
+    switch (op->kind) {
+    case FSTD_ALLOC_TRACE_ALLOC:
+      ptrs[op->slot] = target_alloc(target, op->size, op->align);
+      break;
+    case FSTD_ALLOC_TRACE_REALLOC:
+      ptrs[op->slot] = target_realloc(
+          target, ptrs[op->slot], sizes[op->slot], op->size, op->align);
+      break;
+    case FSTD_ALLOC_TRACE_FREE:
+      target_free(target, ptrs[op->slot]);
+      ptrs[op->slot] = NULL;
+      break;
+    }
+
+    if (samples != NULL) {
+      samples[i] = bench_now_ns() - op_start;
+      total += samples[i];
+    }
+
+    if (op->kind != FSTD_ALLOC_TRACE_FREE) {
+      bench_touch(ptrs[op->slot], op->size);
+      sizes[op->slot] = op->size;
+    }
+  }
+
+  if (samples == NULL) {
+    total = bench_now_ns() - start;
+  }
+
+  for (size_t i = 0; i < trace->slot_count; i++) {
+    if (ptrs[i] != NULL) {
+      target_free(target, ptrs[i]);
+      ptrs[i] = NULL;
+    }
+  }
+
+  return total;
+}
+
+static void run(target_t *target, const trace_t *trace) {
+  void **ptrs = calloc(trace->slot_count, sizeof(void *));
+  size_t *sizes = calloc(trace->slot_count, sizeof(size_t));
+  uint64_t *samples = malloc(sizeof(uint64_t) * trace->op_count);
+  memset(samples, 0, sizeof(uint64_t) * trace->op_count);
+
+  if (target->kind == TARGET_ALLOCATOR) {
+    fstd_allocator_options_t options = {0};
+    options.block_size = 1 << 20;
+    options.max_block_size = 64 << 20;
+    options.fit = target->fit;
+    options.aligned_blocks = target->aligned_blocks;
+    fstd_allocator_init_with_options(&target->allocator, &options);
+  } else if (target->kind == TARGET_HEAP) {
+    fstd_heap_init(&target->heap);
+  }
+
+  uint64_t base_rss = bench_peak_rss();
+
+  // Throughput without timing every call, then latency with
+  uint64_t elapsed = replay(target, trace, ptrs, sizes, NULL);
+  replay(target, trace, ptrs, sizes, samples);
+
+  uint64_t peak_rss = bench_peak_rss() - base_rss;
+
+  bench_sort(samples, trace->op_count);
+  printf(
+      "%-8s %8.2f  %5llu  %6llu  %7llu  %9llu  %9.1f\n",
+      target->name,
+      (double)trace->op_count * 1e3 / (double)elapsed,
+      (unsigned long long)bench_percentile(samples, trace->op_count, 50.0),
+      (unsigned long long)bench_percentile(samples, trace->op_count, 99.0),
+      (unsigned long long)bench_percentile(samples, trace->op_count, 99.9),
+      (unsigned long long)samples[trace->op_count - 1],
+      (double)peak_rss / (1024.0 * 1024.0));
+  fflush(stdout);
+
+  if (target->kind == TARGET_ALLOCATOR) {
+    fstd_allocator_destroy(&target->allocator);
+  } else if (target->kind == TARGET_HEAP) {
+    fstd_heap_destroy(&target->heap);
+  }
+  free(samples);
+  free(sizes);
+  free(ptrs);
+}
+
+int main(int argc, char **argv) {
+  trace_t trace = {0};
+  if (argc > 1) {
+    if (!trace_load(&trace, argv[1])) {
+      return 1;
+    }
+  } else {
+    trace_synthesize(&trace);
+  }
+
+  if (trace.op_count == 0) {
+    fprintf(stderr, "nothing to replay\n");
+    return 1;
+  }
+
+  printf(
+      "%zu allocs, %zu reallocs, %zu frees, %zu slots",
+      trace.alloc_count,
+      trace.realloc_count,
+      trace.free_count,
+      trace.slot_count);
+  if (argc > 1) {
+    printf(", recorded over %.3f s", (double)trace.duration / 1e9);
+  }
+  printf("\n");
+  printf(
+      "target     Mops/s  p50ns  p99ns  p999ns      maxns  peak RSS MiB\n");
+
+  target_t targets[] = {
+      {.name = "first", .kind = TARGET_ALLOCATOR, .fit = FSTD_ALLOC_FIT_FIRST},
+      {.name = "next", .kind = TARGET_ALLOCATOR, .fit = FSTD_ALLOC_FIT_NEXT},
+      {.name = "best", .kind = TARGET_ALLOCATOR, .fit = FSTD_ALLOC_FIT_BEST},
+      {.name = "tlsf", .kind = TARGET_ALLOCATOR, .fit = FSTD_ALLOC_FIT_TLSF},
+      {.name = "aligned",
+       .kind = TARGET_ALLOCATOR,
+       .fit = FSTD_ALLOC_FIT_TLSF,
+       .aligned_blocks = true},
+      {.name = "heap", .kind = TARGET_HEAP},
+      {.name = "libc", .kind = TARGET_LIBC},
+  };
+
+  for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+      run(&targets[i], &trace);
+      _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "%s crashed\n", targets[i].name);
+    }
+  }
+
+  free(trace.ops);
+  return 0;
+}
@@ -0,0 +1,378 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Allocation patterns run against fstd_allocator_t (with and without slabs)
+// and libc malloc, and fstd_stack_allocator_t for the ones that free in LIFO order, all through
+// fstd_alloc_interface_t and each in its own process so peak RSS can be told
+// apart. Prints one JSON object per line, or CSV with --csv, so results
+// can be compared across commits.
+//
+//   alloc_suite [--csv] [benchmark...]
+//
+// Runs every benchmark when none is named.
+
+#define SMALL_COUNT 100000
+#define SMALL_ROUNDS 20
+#define MIXED_LIVE_COUNT 10000
+#define MIXED_OP_COUNT 2000000
+#define LIFO_COUNT 10000
+#define LIFO_ROUNDS 100
+#define FIFO_WINDOW 10000
+#define FIFO_OP_COUNT 2000000
+#define REALLOC_COUNT 1024
+#define REALLOC_MAX_SIZE (64 << 10)
+#define REALLOC_STEP 64
+#define CHURN_LIVE_COUNT 50000
+#define CHURN_ROUNDS 20
+
+typedef struct result_t {
+  size_t op_count;
+  uint64_t elapsed;
+  // How much of the free space is not in the largest free chunk, or -1 when
+  // the allocator can't tell
+  double fragmentation;
+} result_t;
+
+typedef struct run_t {
+  fstd_alloc_interface_t interface;
+  fstd_allocator_t *allocator; // NULL for libc
+  uint64_t rng;
+} run_t;
+
+static void *run_alloc(run_t *run, size_t size) {
+  void *ptr = run->interface.alloc(run->interface.ctx, size);
+  bench_touch(ptr, size);
+  return ptr;
+}
+
+static void run_free(run_t *run, void *ptr, size_t size) {
+  run->interface.free(run->interface.ctx, ptr, size);
+}
+
+// Log-uniform between 16 and 4096 bytes
+static size_t random_size(run_t *run) {
+  size_t size = (size_t)16 << (bench_rand(&run->rng) % 8);
+  return size + bench_rand(&run->rng) % size;
+}
+
+static double fragmentation(run_t *run) {
+  if (run->allocator == NULL) {
+    return -1.0;
+  }
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(run->allocator, &stats);
+  if (stats.free_bytes == 0) {
+    return 0.0;
+  }
+  return 1.0 - (double)stats.largest_free / (double)stats.free_bytes;
+}
+
+// Many allocations of one small size, all freed at once
+static result_t bench_small(run_t *run) {
+  void **ptrs = malloc(sizeof(void *) * SMALL_COUNT);
+  result_t result = {SMALL_COUNT * SMALL_ROUNDS * 2, 0, -1.0};
+
+  uint64_t start = bench_now_ns();
+  for (size_t round = 0; round < SMALL_ROUNDS; round++) {
+    for (size_t i = 0; i < SMALL_COUNT; i++) {
+      ptrs[i] = run_alloc(run, 32);
+    }
+    for (size_t i = 0; i < SMALL_COUNT; i++) {
+      run_free(run, ptrs[i], 32);
+    }
+  }
+  result.elapsed = bench_now_ns() - start;
+
+  free(ptrs);
+  return result;
+}
+
+// Random sizes freed in random order
+static result_t bench_mixed(run_t *run) {
+  void **ptrs = calloc(MIXED_LIVE_COUNT, sizeof(void *));
+  size_t *sizes = calloc(MIXED_LIVE_COUNT, sizeof(size_t));
+  result_t result = {MIXED_OP_COUNT, 0, -1.0};
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < MIXED_OP_COUNT; i++) {
+    size_t slot = bench_rand(&run->rng) % MIXED_LIVE_COUNT;
+    if (ptrs[slot] != NULL) {
+      run_free(run, ptrs[slot], sizes[slot]);
+      ptrs[slot] = NULL;
+    } else {
+      sizes[slot] = random_size(run);
+      ptrs[slot] = run_alloc(run, sizes[slot]);
+    }
+  }
+  result.elapsed = bench_now_ns() - start;
+  result.fragmentation = fragmentation(run);
+
+  for (size_t i = 0; i < MIXED_LIVE_COUNT; i++) {
+    if (ptrs[i] != NULL) {
+      run_free(run, ptrs[i], sizes[i]);
+    }
+  }
+  free(sizes);
+  free(ptrs);
+  return result;
+}
+
+// Freed in the reverse order of allocation, like a stack
+static result_t bench_lifo(run_t *run) {
+  void **ptrs = malloc(sizeof(void *) * LIFO_COUNT);
+  size_t *sizes = malloc(sizeof(size_t) * LIFO_COUNT);
+  result_t result = {LIFO_COUNT * LIFO_ROUNDS * 2, 0, -1.0};
+
+  for (size_t i = 0; i < LIFO_COUNT; i++) {
+    sizes[i] = random_size(run);
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t round = 0; round < LIFO_ROUNDS; round++) {
+    for (size_t i = 0; i < LIFO_COUNT; i++) {
+      ptrs[i] = run_alloc(run, sizes[i]);
+    }
+    for (size_t i = LIFO_COUNT; i > 0; i--) {
+      run_free(run, ptrs[i - 1], sizes[i - 1]);
+    }
+  }
+  result.elapsed = bench_now_ns() - start;
+
+  free(sizes);
+  free(ptrs);
+  return result;
+}
+
+// Freed in the order of allocation, like a queue
+static result_t bench_fifo(run_t *run) {
+  void **ptrs = calloc(FIFO_WINDOW, sizeof(void *));
+  size_t *sizes = calloc(FIFO_WINDOW, sizeof(size_t));
+  result_t result = {FIFO_OP_COUNT, 0, -1.0};
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < FIFO_OP_COUNT; i += 2) {
+    size_t slot = (i / 2) % FIFO_WINDOW;
+    if (ptrs[slot] != NULL) {
+      run_free(run, ptrs[slot], sizes[slot]);
+    }
+    sizes[slot] = random_size(run);
+    ptrs[slot] = run_alloc(run, sizes[slot]);
+  }
+  result.elapsed = bench_now_ns() - start;
+  result.fragmentation = fragmentation(run);
+
+  for (size_t i = 0; i < FIFO_WINDOW; i++) {
+    if (ptrs[i] != NULL) {
+      run_free(run, ptrs[i], sizes[i]);
+    }
+  }
+  free(sizes);
+  free(ptrs);
+  return result;
+}
+
+// Buffers growing a little at a time, interleaved so they get in each
+// other's way
+static result_t bench_realloc(run_t *run) {
+  void **ptrs = calloc(REALLOC_COUNT, sizeof(void *));
+  size_t *sizes = calloc(REALLOC_COUNT, sizeof(size_t));
+  size_t step_count = REALLOC_MAX_SIZE / REALLOC_STEP;
+  result_t result = {REALLOC_COUNT * step_count, 0, -1.0};
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < result.op_count; i++) {
+    size_t slot = bench_rand(&run->rng) % REALLOC_COUNT;
+    while (sizes[slot] == REALLOC_MAX_SIZE) {
+      slot = (slot + 1) % REALLOC_COUNT;
+    }
+
+    size_t size = sizes[slot] + REALLOC_STEP;
+    ptrs[slot] = run->interface.realloc(
+        run->interface.ctx, ptrs[slot], sizes[slot], size);
+    bench_touch((uint8_t *)ptrs[slot] + sizes[slot], REALLOC_STEP);
+    sizes[slot] = size;
+  }
+  result.elapsed = bench_now_ns() - start;
+  result.fragmentation = fragmentation(run);
+
+  for (size_t i = 0; i < REALLOC_COUNT; i++) {
+    run_free(run, ptrs[i], sizes[i]);
+  }
+  free(sizes);
+  free(ptrs);
+  return result;
+}
+
+// Rounds of freeing half of the live objects at random and replacing them
+// with bigger ones, after which free space is scattered in small pieces
+static result_t bench_churn(run_t *run) {
+  void **ptrs = calloc(CHURN_LIVE_COUNT, sizeof(void *));
+  size_t *sizes = calloc(CHURN_LIVE_COUNT, sizeof(size_t));
+  result_t result = {0, 0, -1.0};
+
+  for (size_t i = 0; i < CHURN_LIVE_COUNT; i++) {
+    sizes[i] = 16 + bench_rand(&run->rng) % 256;
+    ptrs[i] = run_alloc(run, sizes[i]);
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t round = 0; round < CHURN_ROUNDS; round++) {
+    for (size_t i = 0; i < CHURN_LIVE_COUNT; i++) {
+      if (bench_rand(&run->rng) % 2 == 0) {
+        run_free(run, ptrs[i], sizes[i]);
+        sizes[i] = 16 + bench_rand(&run->rng) % (256 + round * 64);
+        ptrs[i] = run_alloc(run, sizes[i]);
+        result.op_count += 2;
+      }
+    }
+  }
+  result.elapsed = bench_now_ns() - start;
+  result.fragmentation = fragmentation(run);
+
+  for (size_t i = 0; i < CHURN_LIVE_COUNT; i++) {
+    run_free(run, ptrs[i], sizes[i]);
+  }
+  free(sizes);
+  free(ptrs);
+  return result;
+}
+
+typedef struct benchmark_t {
+  const char *name;
+  result_t (*fn)(run_t *run);
+  bool nested; // Frees are LIFO, so a stack allocator can run it
+} benchmark_t;
+
+static const benchmark_t benchmarks[] = {
+    {"small", bench_small, false},
+    {"mixed", bench_mixed, false},
+    {"lifo", bench_lifo, true},
+    {"fifo", bench_fifo, false},
+    {"realloc", bench_realloc, false},
+    {"churn", bench_churn, false},
+};
+
+static void
+report(bool csv, const char *benchmark, const char *target, result_t result) {
+  double ns_per_op = (double)result.elapsed / (double)result.op_count;
+  unsigned long long peak_rss = (unsigned long long)bench_peak_rss();
+
+  if (csv) {
+    printf(
+        "%s,%s,%zu,%.2f,%llu,",
+        benchmark,
+        target,
+        result.op_count,
+        ns_per_op,
+        peak_rss);
+    if (result.fragmentation >= 0.0) {
+      printf("%.4f", result.fragmentation);
+    }
+    printf("\n");
+  } else {
+    printf(
+        "{\"benchmark\": \"%s\", \"allocator\": \"%s\", \"ops\": %zu, "
+        "\"ns_per_op\": %.2f, \"peak_rss_bytes\": %llu, "
+        "\"fragmentation\": ",
+        benchmark,
+        target,
+        result.op_count,
+        ns_per_op,
+        peak_rss);
+    if (result.fragmentation >= 0.0) {
+      printf("%.4f}\n", result.fragmentation);
+    } else {
+      printf("null}\n");
+    }
+  }
+  fflush(stdout);
+}
+
+static void run_benchmark(bool csv, const benchmark_t *benchmark) {
+  const char *targets[] = {"fstd", "fstd_slab", "libc", "stack"};
+  size_t target_count = benchmark->nested ? 4 : 3;
+
+  for (size_t i = 0; i < target_count; i++) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+      int status;
+      waitpid(pid, &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s/%s crashed\n", benchmark->name, targets[i]);
+      }
+      continue;
+    }
+
+    run_t run;
+    run.rng = 0x9E3779B97F4A7C15ull;
+
+    fstd_allocator_t allocator;
+    fstd_stack_allocator_t stack;
+    run.allocator = NULL;
+    if (i <= 1) {
+      fstd_allocator_options_t options = {0};
+      options.block_size = 1 << 20;
+      options.max_block_size = 64 << 20;
+      if (i == 1) {
+        options.slab_max_size = FSTD_ALLOC_SLAB_MAX_SIZE;
+      }
+      fstd_allocator_init_with_options(&allocator, &options);
+      run.interface = fstd_alloc_interface_allocator(&allocator);
+      run.allocator = &allocator;
+    } else if (i == 2) {
+      run.interface = fstd_alloc_interface_libc();
+    } else {
+      fstd_stack_allocator_init(&stack, 1 << 20);
+      run.interface = fstd_alloc_interface_stack(&stack);
+    }
+
+    report(csv, benchmark->name, targets[i], benchmark->fn(&run));
+
+    if (i <= 1) {
+      fstd_allocator_destroy(&allocator);
+    } else if (i == 3) {
+      fstd_stack_allocator_destroy(&stack);
+    }
+    _exit(0);
+  }
+}
+
+int main(int argc, char **argv) {
+  bool csv = false;
+  int first_name = 1;
+  if (argc > 1 && strcmp(argv[1], "--csv") == 0) {
+    csv = true;
+    first_name = 2;
+  }
+
+  if (csv) {
+    printf("benchmark,allocator,ops,ns_per_op,peak_rss_bytes,fragmentation\n");
+  }
+
+  size_t benchmark_count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  if (first_name == argc) {
+    for (size_t i = 0; i < benchmark_count; i++) {
+      run_benchmark(csv, &benchmarks[i]);
+    }
+    return 0;
+  }
+
+  for (int arg = first_name; arg < argc; arg++) {
+    size_t i = 0;
+    while (i < benchmark_count && strcmp(benchmarks[i].name, argv[arg]) != 0) {
+      i++;
+    }
+    if (i == benchmark_count) {
+      fprintf(stderr, "unknown benchmark %s\n", argv[arg]);
+      return 1;
+    }
+    run_benchmark(csv, &benchmarks[i]);
+  }
+  return 0;
+}
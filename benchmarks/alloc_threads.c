@@ -0,0 +1,170 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+// Producer/consumer pairs: producers allocate objects and hand them to their
+// consumer through a ring buffer, consumers free them. Compares one
+// fstd_allocator_t behind a mutex with one fstd_heap_t per thread, where
+// every free is a remote free. Throughput should grow with the pair count
+// as long as there are cores for it.
+
+#define MAX_PAIRS 16
+#define OBJECT_COUNT (1 << 20)
+#define RING_SIZE 1024
+
+typedef struct ring_t {
+  void *slots[RING_SIZE];
+  size_t head; // Written by the consumer
+  char pad[64];
+  size_t tail; // Written by the producer
+} ring_t;
+
+static void ring_push(ring_t *ring, void *ptr) {
+  size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING_SIZE) {
+    sched_yield();
+  }
+  ring->slots[tail % RING_SIZE] = ptr;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static void *ring_pop(ring_t *ring) {
+  size_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+    sched_yield();
+  }
+  void *ptr = ring->slots[head % RING_SIZE];
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+  return ptr;
+}
+
+typedef enum run_mode_t {
+  MODE_LOCKED,
+  MODE_HEAPS,
+} run_mode_t;
+
+typedef struct shared_t {
+  pthread_mutex_t mutex;
+  fstd_allocator_t allocator;
+} shared_t;
+
+typedef struct worker_t {
+  run_mode_t mode;
+  shared_t *shared;
+  ring_t *ring;
+  fstd_heap_t heap;
+  uint64_t seed;
+} worker_t;
+
+static void *producer(void *arg) {
+  worker_t *worker = arg;
+  uint64_t rng = worker->seed;
+
+  for (size_t i = 0; i < OBJECT_COUNT; i++) {
+    size_t size = 16 + bench_rand(&rng) % 241;
+
+    uint8_t *ptr;
+    if (worker->mode == MODE_LOCKED) {
+      pthread_mutex_lock(&worker->shared->mutex);
+      ptr = fstd_alloc(&worker->shared->allocator, size);
+      pthread_mutex_unlock(&worker->shared->mutex);
+    } else {
+      ptr = fstd_heap_alloc(&worker->heap, size);
+    }
+
+    ptr[0] = (uint8_t)i;
+    ring_push(worker->ring, ptr);
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg) {
+  worker_t *worker = arg;
+
+  for (size_t i = 0; i < OBJECT_COUNT; i++) {
+    uint8_t *ptr = ring_pop(worker->ring);
+    if (ptr[0] != (uint8_t)i) {
+      fprintf(stderr, "corrupted object\n");
+      abort();
+    }
+
+    if (worker->mode == MODE_LOCKED) {
+      pthread_mutex_lock(&worker->shared->mutex);
+      fstd_free(&worker->shared->allocator, ptr);
+      pthread_mutex_unlock(&worker->shared->mutex);
+    } else {
+      fstd_heap_free(&worker->heap, ptr);
+    }
+  }
+  return NULL;
+}
+
+// Returns millions of objects allocated and freed per second
+static double run(run_mode_t mode, size_t pair_count) {
+  shared_t shared;
+  pthread_mutex_init(&shared.mutex, NULL);
+  fstd_allocator_init(&shared.allocator, 4 << 20);
+
+  ring_t *rings = calloc(pair_count, sizeof(ring_t));
+  worker_t *workers = calloc(pair_count * 2, sizeof(worker_t));
+  pthread_t *threads = calloc(pair_count * 2, sizeof(pthread_t));
+
+  for (size_t i = 0; i < pair_count * 2; i++) {
+    workers[i].mode = mode;
+    workers[i].shared = &shared;
+    workers[i].ring = &rings[i / 2];
+    workers[i].seed = 0x9E3779B97F4A7C15ull * (i + 1);
+    fstd_heap_init(&workers[i].heap);
+  }
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < pair_count * 2; i++) {
+    pthread_create(
+        &threads[i], NULL, i % 2 == 0 ? producer : consumer, &workers[i]);
+  }
+  for (size_t i = 0; i < pair_count * 2; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  for (size_t i = 0; i < pair_count * 2; i++) {
+    fstd_heap_destroy(&workers[i].heap);
+  }
+  fstd_allocator_destroy(&shared.allocator);
+  pthread_mutex_destroy(&shared.mutex);
+  free(threads);
+  free(workers);
+  free(rings);
+
+  return (double)(OBJECT_COUNT * pair_count) * 1e3 / (double)elapsed;
+}
+
+int main(int argc, char **argv) {
+  size_t max_pairs = argc > 1 ? (size_t)atoi(argv[1]) : 4;
+  if (max_pairs < 1 || max_pairs > MAX_PAIRS) {
+    max_pairs = 4;
+  }
+
+  printf("pairs  locked Mops/s  heaps Mops/s  heaps speedup\n");
+
+  double heaps_base = 0.0;
+  for (size_t pairs = 1; pairs <= max_pairs; pairs *= 2) {
+    double locked = run(MODE_LOCKED, pairs);
+    double heaps = run(MODE_HEAPS, pairs);
+    if (pairs == 1) {
+      heaps_base = heaps;
+    }
+
+    printf(
+        "%5zu  %13.2f  %12.2f  %12.2fx\n",
+        pairs,
+        locked,
+        heaps,
+        heaps / heaps_base);
+  }
+
+  return 0;
+}
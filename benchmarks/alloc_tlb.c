@@ -0,0 +1,132 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Pointer chasing through nodes linked in random order, with block storage
+// from malloc, regular page mappings and huge page mappings. Reports dTLB
+// load misses when perf events are available.
+
+#define NODE_COUNT (1 << 20)
+#define HOP_COUNT (1 << 24)
+
+typedef struct node_t {
+  struct node_t *next;
+  uint64_t payload[7];
+} node_t;
+
+static int tlb_counter_open(void) {
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static void tlb_counter_start(int fd) {
+#if defined(__linux__)
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#else
+  (void)fd;
+#endif
+}
+
+static long long tlb_counter_stop(int fd) {
+#if defined(__linux__)
+  long long count = -1;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+      count = -1;
+    }
+  }
+  return count;
+#else
+  (void)fd;
+  return -1;
+#endif
+}
+
+static void run(const char *name, fstd_alloc_storage_t storage, int tlb_fd) {
+  fstd_allocator_options_t options = {0};
+  options.block_size = 32 << 20;
+  options.storage = storage;
+
+  fstd_allocator_t allocator;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  node_t **nodes = malloc(sizeof(node_t *) * NODE_COUNT);
+  for (size_t i = 0; i < NODE_COUNT; i++) {
+    nodes[i] = fstd_alloc(&allocator, sizeof(node_t));
+  }
+
+  // Shuffle, then link in shuffled order so every hop lands somewhere else
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+  for (size_t i = NODE_COUNT - 1; i > 0; i--) {
+    size_t j = bench_rand(&rng) % (i + 1);
+    node_t *tmp = nodes[i];
+    nodes[i] = nodes[j];
+    nodes[j] = tmp;
+  }
+  for (size_t i = 0; i < NODE_COUNT; i++) {
+    nodes[i]->next = nodes[(i + 1) % NODE_COUNT];
+  }
+
+  node_t *node = nodes[0];
+  tlb_counter_start(tlb_fd);
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < HOP_COUNT; i++) {
+    node = node->next;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  long long tlb_misses = tlb_counter_stop(tlb_fd);
+
+  printf(
+      "%-10s ns/hop %6.2f  dTLB misses/hop ",
+      name,
+      (double)elapsed / HOP_COUNT);
+  if (tlb_misses >= 0) {
+    printf("%.3f", (double)tlb_misses / HOP_COUNT);
+  } else {
+    printf("n/a");
+  }
+  printf("%s\n", node == NULL ? "!" : "");
+
+  free(nodes);
+  fstd_allocator_destroy(&allocator);
+}
+
+int main() {
+  int tlb_fd = tlb_counter_open();
+
+  run("malloc", FSTD_ALLOC_STORAGE_MALLOC, tlb_fd);
+  run("map", FSTD_ALLOC_STORAGE_MAP, tlb_fd);
+  run("huge_pages", FSTD_ALLOC_STORAGE_HUGE_PAGES, tlb_fd);
+
+#if defined(__linux__)
+  if (tlb_fd >= 0) {
+    close(tlb_fd);
+  }
+#endif
+  return 0;
+}
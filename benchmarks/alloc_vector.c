@@ -0,0 +1,86 @@
+#include "bench.h"
+#include <fstd_alloc.h>
+#include <stdio.h>
+#include <string.h>
+
+// Growable buffers doubling their capacity with realloc, with pushes spread
+// over several buffers at random so they grow into each other's way.
+// Reports how many reallocs didn't move the buffer and the time per push,
+// for fstd_realloc and for libc realloc.
+
+#define VECTOR_COUNT 64
+#define PUSH_COUNT (1 << 22)
+
+typedef struct vector_t {
+  uint32_t *items;
+  size_t count;
+  size_t capacity;
+} vector_t;
+
+static void run(const char *name, fstd_allocator_t *allocator) {
+  vector_t vectors[VECTOR_COUNT];
+  memset(vectors, 0, sizeof(vectors));
+
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+  size_t realloc_count = 0;
+  size_t in_place_count = 0;
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < PUSH_COUNT; i++) {
+    vector_t *vector = &vectors[bench_rand(&rng) % VECTOR_COUNT];
+
+    if (vector->count == vector->capacity) {
+      size_t capacity = vector->capacity == 0 ? 4 : vector->capacity * 2;
+      uint32_t *items =
+          allocator != NULL
+              ? fstd_realloc(
+                    allocator, vector->items, capacity * sizeof(uint32_t))
+              : realloc(vector->items, capacity * sizeof(uint32_t));
+
+      realloc_count++;
+      if (items == vector->items) {
+        in_place_count++;
+      }
+
+      vector->items = items;
+      vector->capacity = capacity;
+    }
+
+    vector->items[vector->count++] = (uint32_t)i;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  uint64_t checksum = 0;
+  for (size_t i = 0; i < VECTOR_COUNT; i++) {
+    for (size_t j = 0; j < vectors[i].count; j++) {
+      checksum += vectors[i].items[j];
+    }
+    if (allocator != NULL) {
+      fstd_free(allocator, vectors[i].items);
+    } else {
+      free(vectors[i].items);
+    }
+  }
+
+  printf(
+      "%-6s ns/push %6.2f  reallocs %6zu  in place %5.1f%%  checksum %llu\n",
+      name,
+      (double)elapsed / PUSH_COUNT,
+      realloc_count,
+      100.0 * (double)in_place_count / (double)realloc_count,
+      (unsigned long long)checksum);
+}
+
+int main() {
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 20;
+  options.max_block_size = 64 << 20;
+
+  fstd_allocator_t allocator;
+  fstd_allocator_init_with_options(&allocator, &options);
+  run("fstd", &allocator);
+  fstd_allocator_destroy(&allocator);
+
+  run("libc", NULL);
+  return 0;
+}
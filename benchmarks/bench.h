@@ -0,0 +1,79 @@
+#ifndef FSTD_BENCH_H
+#define FSTD_BENCH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+static inline uint64_t bench_now_ns(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Highest resident set size of the process so far, in bytes
+static inline uint64_t bench_peak_rss(void) {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+  return (uint64_t)counters.PeakWorkingSetSize;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return (uint64_t)usage.ru_maxrss;
+#else
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// xorshift64*, so runs are reproducible across platforms
+static inline uint64_t bench_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1Dull;
+}
+
+// Writes to every page of `ptr` so it counts towards the RSS
+static inline void bench_touch(void *ptr, size_t size) {
+  for (size_t i = 0; i < size; i += 4096) {
+    ((volatile uint8_t *)ptr)[i] = 1;
+  }
+}
+
+static inline int bench__compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static inline void bench_sort(uint64_t *samples, size_t count) {
+  qsort(samples, count, sizeof(uint64_t), bench__compare_u64);
+}
+
+// Value at `percentile` (0-100) of already sorted `samples`.
+static inline uint64_t
+bench_percentile(const uint64_t *samples, size_t count, double percentile) {
+  size_t index = (size_t)((double)(count - 1) * percentile / 100.0);
+  return samples[index];
+}
+
+#endif
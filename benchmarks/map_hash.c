@@ -0,0 +1,154 @@
+#include "bench.h"
+#include <fstd_map.h>
+#include <stdio.h>
+
+// Throughput of the map's hash functions on realistic keys, and how long
+// the probes are when those keys are put in a linearly probed map at 75%
+// load. A probe's length is the number of bundles it looks at to find its
+// key. The capacity is a power of two, as it is for maps that have grown
+// from one, so only the low bits of the hashes pick the bundles.
+
+#define CAPACITY (1 << 16)
+#define KEY_COUNT (CAPACITY / 4 * 3)
+#define HASH_ROUNDS 64
+#define KEY_SIZE 128
+
+static char keys[KEY_COUNT][KEY_SIZE];
+
+static const char *words[] = {
+    "user",   "account", "order",  "item",   "cart",     "session",
+    "image",  "static",  "api",    "v2",     "profile",  "settings",
+    "search", "product", "review", "thumb",  "category", "invoice",
+    "get",    "set",     "update", "delete", "count",    "index",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static const char *word(uint64_t *rng) {
+  return words[bench_rand(rng) % WORD_COUNT];
+}
+
+static void make_urls(uint64_t *rng) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(
+        keys[i],
+        KEY_SIZE,
+        "https://www.example.com/%s/%s/%s?id=%llu",
+        word(rng),
+        word(rng),
+        word(rng),
+        (unsigned long long)(bench_rand(rng) % 1000000));
+  }
+}
+
+static void make_identifiers(uint64_t *rng) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(
+        keys[i],
+        KEY_SIZE,
+        "%s_%s_%s%llu",
+        word(rng),
+        word(rng),
+        word(rng),
+        (unsigned long long)(bench_rand(rng) % 1000));
+  }
+}
+
+// Like database ids, which only differ in their last few characters
+static void make_sequential(uint64_t *rng) {
+  (void)rng;
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(keys[i], KEY_SIZE, "user:%zu", i);
+  }
+}
+
+static void make_uuids(uint64_t *rng) {
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    uint64_t high = bench_rand(rng);
+    uint64_t low = bench_rand(rng);
+    snprintf(
+        keys[i],
+        KEY_SIZE,
+        "%08llx-%04llx-4%03llx-%04llx-%012llx",
+        (unsigned long long)(high >> 32),
+        (unsigned long long)((high >> 16) & 0xFFFF),
+        (unsigned long long)(high & 0xFFF),
+        (unsigned long long)(0x8000 | (low >> 48 & 0x3FFF)),
+        (unsigned long long)(low & 0xFFFFFFFFFFFFull));
+  }
+}
+
+static void
+run(const char *keys_name, const char *name, fstd_map_hash_fn_t fn) {
+  uint64_t bytes = 0;
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    bytes += strlen(keys[i]);
+  }
+
+  uint64_t sink = 0;
+  uint64_t start = bench_now_ns();
+  for (int round = 0; round < HASH_ROUNDS; round++) {
+    for (size_t i = 0; i < KEY_COUNT; i++) {
+      sink += fn(keys[i], (uint64_t)round);
+    }
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  if (sink == 1) {
+    printf("unreachable\n");
+  }
+
+  // Duplicate keys are set twice, so `filled` can end up below KEY_COUNT
+  fstd_map_t map;
+  fstd_map_init(&map, CAPACITY, uint64_t);
+  map.max_load = 1.0f;
+  map.hash_fn = fn;
+  for (uint64_t i = 0; i < KEY_COUNT; i++) {
+    fstd_map_set(&map, keys[i], &i);
+  }
+
+  uint64_t *probes = malloc(sizeof(uint64_t) * KEY_COUNT);
+  uint64_t probe_total = 0;
+  for (size_t i = 0; i < KEY_COUNT; i++) {
+    char *value = fstd_map_get(&map, keys[i]);
+    size_t index =
+        (size_t)(value - map.value_offset - (char *)map.bundles) /
+        map.bundle_size;
+    size_t home = (size_t)fn(keys[i], map.seed) % map.capacity;
+    probes[i] = (index + map.capacity - home) % map.capacity + 1;
+    probe_total += probes[i];
+  }
+  bench_sort(probes, KEY_COUNT);
+
+  printf(
+      "%-12s %-5s %6.1f ns/key  %6.2f GB/s  probes: mean %7.2f  p99 %5llu  "
+      "max %6llu\n",
+      keys_name,
+      name,
+      (double)elapsed / ((double)KEY_COUNT * HASH_ROUNDS),
+      (double)bytes * HASH_ROUNDS / (double)elapsed,
+      (double)probe_total / KEY_COUNT,
+      (unsigned long long)bench_percentile(probes, KEY_COUNT, 99.0),
+      (unsigned long long)probes[KEY_COUNT - 1]);
+
+  free(probes);
+  fstd_map_destroy(&map);
+}
+
+int main() {
+  struct {
+    const char *name;
+    void (*make)(uint64_t *rng);
+  } key_sets[] = {
+      {"urls", make_urls},
+      {"identifiers", make_identifiers},
+      {"sequential", make_sequential},
+      {"uuids", make_uuids},
+  };
+
+  for (size_t i = 0; i < sizeof(key_sets) / sizeof(key_sets[0]); i++) {
+    uint64_t rng = 42;
+    key_sets[i].make(&rng);
+    run(key_sets[i].name, "djb", fstd_map_djb_hash);
+    run(key_sets[i].name, "wy", fstd_map_wyhash);
+  }
+  return 0;
+}
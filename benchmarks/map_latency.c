@@ -0,0 +1,60 @@
+#include "bench.h"
+#include <fstd_map.h>
+#include <stdio.h>
+
+// Per-call latency of fstd_map_set while a map grows from empty to
+// KEY_COUNT keys, rehashing all at once and incrementally. All-at-once
+// rehashes show up as a handful of very slow calls, incremental ones spread
+// the same work over the calls that follow.
+
+#define KEY_COUNT (1 << 21)
+
+static void run(const char *name, size_t rehash_step) {
+  fstd_map_t map;
+  fstd_map_init(&map, 16, uint64_t);
+  map.rehash_step = rehash_step;
+
+  uint64_t *samples = malloc(sizeof(uint64_t) * KEY_COUNT);
+  char key[32];
+
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(key, sizeof(key), "key:%llu", (unsigned long long)i);
+
+    uint64_t start = bench_now_ns();
+    fstd_map_set(&map, key, &i);
+    uint64_t elapsed = bench_now_ns() - start;
+
+    samples[i] = elapsed;
+    total += elapsed;
+  }
+
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < KEY_COUNT; i++) {
+    snprintf(key, sizeof(key), "key:%llu", (unsigned long long)i);
+    uint64_t *value = fstd_map_get(&map, key);
+    found += value != NULL && *value == i;
+  }
+
+  bench_sort(samples, KEY_COUNT);
+  printf(
+      "%-12s set ns: mean %6.1f  p50 %5llu  p99 %6llu  p999 %7llu  "
+      "max %10llu  found %llu\n",
+      name,
+      (double)total / KEY_COUNT,
+      (unsigned long long)bench_percentile(samples, KEY_COUNT, 50.0),
+      (unsigned long long)bench_percentile(samples, KEY_COUNT, 99.0),
+      (unsigned long long)bench_percentile(samples, KEY_COUNT, 99.9),
+      (unsigned long long)samples[KEY_COUNT - 1],
+      (unsigned long long)found);
+
+  free(samples);
+  fstd_map_destroy(&map);
+}
+
+int main() {
+  run("all at once", 0);
+  run("step 16", 16);
+  run("step 256", 256);
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench.h"
+#include <fstd_map.h>
+#include <stdio.h>
+
+// Cost of fstd_map_get for keys that are there and keys that aren't, in
+// maps of CAPACITY bundles filled up to a given load, probing linearly and
+// probing by groups of control bytes. Misses are where linear probing
+// suffers most, having to walk every bundle up to an empty one. Long keys
+// sharing a prefix make every key comparison that isn't skipped expensive.
+
+#define CAPACITY (1 << 16)
+#define LOOKUP_COUNT (1 << 16)
+
+#define KEY_SIZE 80
+
+static char keys[CAPACITY][KEY_SIZE];
+static char missing_keys[CAPACITY][KEY_SIZE];
+
+static double
+time_lookups(fstd_map_t *map, char (*lookup_keys)[KEY_SIZE], size_t count) {
+  uint64_t rng = 42;
+  size_t found = 0;
+
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < LOOKUP_COUNT; i++) {
+    found += fstd_map_get(map, lookup_keys[bench_rand(&rng) % count]) != NULL;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+
+  // Keep the lookups from being optimized out
+  if (found == SIZE_MAX) {
+    printf("unreachable\n");
+  }
+  return (double)elapsed / LOOKUP_COUNT;
+}
+
+static void run(const char *name, float load) {
+  size_t count = (size_t)(CAPACITY * load);
+
+  double hit_ns[2];
+  double miss_ns[2];
+  for (int grouped = 0; grouped < 2; grouped++) {
+    fstd_map_t map;
+    if (grouped) {
+      fstd_map_init_grouped(&map, CAPACITY, uint64_t);
+    } else {
+      fstd_map_init(&map, CAPACITY, uint64_t);
+    }
+    map.max_load = 1.0f;
+
+    for (uint64_t i = 0; i < count; i++) {
+      fstd_map_set(&map, keys[i], &i);
+    }
+
+    hit_ns[grouped] = time_lookups(&map, keys, count);
+    miss_ns[grouped] = time_lookups(&map, missing_keys, CAPACITY);
+
+    fstd_map_destroy(&map);
+  }
+
+  printf(
+      "%-5s load %.3f  hit ns: linear %6.1f  grouped %6.1f  "
+      "miss ns: linear %7.1f  grouped %6.1f\n",
+      name,
+      (double)load,
+      hit_ns[0],
+      hit_ns[1],
+      miss_ns[0],
+      miss_ns[1]);
+}
+
+static void run_all(const char *name, const char *prefix) {
+  for (size_t i = 0; i < CAPACITY; i++) {
+    snprintf(keys[i], KEY_SIZE, "%skey:%zu", prefix, i);
+    snprintf(missing_keys[i], KEY_SIZE, "%smissing:%zu", prefix, i);
+  }
+
+  run(name, 0.5f);
+  run(name, 0.75f);
+  run(name, 0.875f);
+  run(name, 0.95f);
+}
+
+int main() {
+  run_all("short", "");
+  run_all("long", "https://example.com/assets/images/thumbnails/");
+  return 0;
+}
@@ -1,5 +1,13 @@
+// mremap in fstd_alloc.h
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #define FSTD_ALLOC_IMPLEMENTATION
 #include "fstd_alloc.h"
 
 #define FSTD_MAP_IMPLEMENTATION
 #include "fstd_map.h"
+
+#define FSTD_POOL_IMPLEMENTATION
+#include "fstd_pool.h"
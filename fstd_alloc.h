@@ -2,16 +2,24 @@
 #define FSTD_ALLOC_H
 
 /*
- * NOTE: the library is not thread safe. You will have to handle that yourself.
+ * NOTE: the library is not thread safe. You will have to handle that yourself,
+ * or give each thread its own fstd_heap_t.
  */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "fstd_bitset.h"
+
+#ifdef FSTD_ALLOC_TRACE
+#include <stdio.h>
+#endif
+
 #if defined(_MSC_VER)
 #define FSTD__ALLOC_ALIGNAS(x) __declspec(align(x))
 #elif defined(__clang__)
@@ -22,36 +30,460 @@ extern "C" {
 
 #define FSTD__ALLOC_ALIGNMENT 16
 
-typedef FSTD__ALLOC_ALIGNAS(FSTD__ALLOC_ALIGNMENT) struct fstd_alloc_header_t {
-  size_t size;
-  size_t used;
-  struct fstd_alloc_header_t *prev;
-  struct fstd_alloc_header_t *next;
+/*
+ * Every allocation in a block is preceded by a 4 byte header holding the
+ * distance to the next header, so blocks are limited to 4 GiB. Sizes are
+ * multiples of FSTD__ALLOC_ALIGNMENT, which leaves the low bits for flags.
+ * Free headers also store their size in their last 4 bytes (a boundary tag),
+ * so the previous header can be found when it is free.
+ */
+typedef struct fstd_alloc_header_t {
+  uint32_t size;
 } fstd_alloc_header_t;
 
+#define FSTD__HEADER_USED 1u
+#define FSTD__HEADER_PREV_USED 2u
+#define FSTD__HEADER_FIRST 4u // First header of its block
+#define FSTD__HEADER_LARGE 8u // Allocation with its own mapping
+#define FSTD__HEADER_FLAGS 15u
+
+// Bytes of every block that can't be allocated: padding so the first
+// payload is aligned, and a used header of size 0 marking the end.
+#define FSTD_ALLOC_BLOCK_OVERHEAD 16
+
+// Bytes an allocation of `size` bytes takes up in a block, header included.
+#define FSTD_ALLOC_CHUNK_SIZE(size)                                            \
+  ((size) + sizeof(fstd_alloc_header_t) <= 32                                  \
+       ? (size_t)32                                                            \
+       : ((size) + sizeof(fstd_alloc_header_t) + FSTD__ALLOC_ALIGNMENT - 1) &  \
+             ~(size_t)(FSTD__ALLOC_ALIGNMENT - 1))
+
+// Block size that fits `count` allocations of `size` bytes.
+#define FSTD_ALLOC_BLOCK_SIZE(size, count)                                     \
+  (FSTD_ALLOC_BLOCK_OVERHEAD + FSTD_ALLOC_CHUNK_SIZE(size) * (count))
+
+// Biggest allocation that fits in a block of `block_size` bytes.
+#define FSTD_ALLOC_MAX_SIZE(block_size)                                        \
+  ((block_size) - FSTD_ALLOC_BLOCK_OVERHEAD - sizeof(fstd_alloc_header_t))
+
+// Next header in the same block, or NULL.
+static inline fstd_alloc_header_t *
+fstd_alloc_header_next(fstd_alloc_header_t *header) {
+  fstd_alloc_header_t *next =
+      (fstd_alloc_header_t *)((uint8_t *)header +
+                              (header->size & ~FSTD__HEADER_FLAGS));
+  return (next->size & ~FSTD__HEADER_FLAGS) == 0 ? NULL : next;
+}
+
 typedef struct fstd_alloc_block_t {
   uint8_t *storage;
+  size_t size;
+  size_t mapping_size; // 0 when storage comes from malloc
   fstd_alloc_header_t *first_header;
   struct fstd_alloc_block_t *next;
   struct fstd_alloc_block_t *prev;
+  // Where an arena's allocations in this block ended when it moved on to the
+  // next block
+  size_t arena_offset;
 } fstd_alloc_block_t;
 
+// Allocation too big for a block, served from its own page-aligned mapping.
+// Its header is flagged FSTD__HEADER_LARGE and the payload follows it.
+typedef struct fstd_alloc_large_t {
+  struct fstd_alloc_large_t *prev;
+  struct fstd_alloc_large_t *next;
+  size_t mapping_size;
+  size_t mapping_offset; // From the start of the mapping to this struct
+  struct fstd_allocator_t *owner;
+  uint32_t padding;
+  fstd_alloc_header_t header;
+} fstd_alloc_large_t;
+
+// Small allocations can be served from slabs instead: mappings of
+// FSTD_ALLOC_SLAB_SIZE bytes, aligned to their size, split into equal slots
+// with no header. Which slots are used is kept in a bitset at the start of
+// the slab, which is found by masking a slot's address.
+#ifndef FSTD_ALLOC_SLAB_SIZE
+#define FSTD_ALLOC_SLAB_SIZE (64 * 1024)
+#endif
+
+// Biggest slot size, slot sizes being multiples of FSTD__ALLOC_ALIGNMENT
+#define FSTD_ALLOC_SLAB_MAX_SIZE 128
+#define FSTD__ALLOC_SLAB_CLASS_COUNT                                           \
+  (FSTD_ALLOC_SLAB_MAX_SIZE / FSTD__ALLOC_ALIGNMENT)
+#define FSTD__ALLOC_SLAB_MAX_SLOTS (FSTD_ALLOC_SLAB_SIZE / FSTD__ALLOC_ALIGNMENT)
+
+typedef struct fstd_alloc_slab_t {
+  // In the list of slabs with free slots of the same size
+  struct fstd_alloc_slab_t *prev;
+  struct fstd_alloc_slab_t *next;
+  uint32_t slot_size;
+  uint32_t slot_count;
+  uint32_t used_count;
+  uint32_t hint; // There are no free slots before this one
+  FSTD_BITSET(FSTD__ALLOC_SLAB_MAX_SLOTS) used;
+} fstd_alloc_slab_t;
+
+// Bytes before the first slot of a slab
+#define FSTD__ALLOC_SLAB_OVERHEAD                                              \
+  ((sizeof(fstd_alloc_slab_t) + FSTD__ALLOC_ALIGNMENT - 1) &                   \
+   ~(size_t)(FSTD__ALLOC_ALIGNMENT - 1))
+
+// Free headers are binned in two levels: the first level is the size's
+// highest set bit, the second level splits that power of two range into
+// FSTD__ALLOC_SL_COUNT linear slices.
+#define FSTD__ALLOC_FL_COUNT (sizeof(size_t) * 8)
+#define FSTD__ALLOC_SL_LOG2 4
+#define FSTD__ALLOC_SL_COUNT (1 << FSTD__ALLOC_SL_LOG2)
+
+typedef enum fstd_alloc_fit_t {
+  // Takes the first header that fits in the request's own size class, then
+  // falls back to the smallest non-empty bigger class.
+  FSTD_ALLOC_FIT_FIRST,
+  // Tries the header left over by the last split or free first, so
+  // consecutive allocations tend to be next to each other, then falls back
+  // to FSTD_ALLOC_FIT_FIRST.
+  FSTD_ALLOC_FIT_NEXT,
+  // Takes the smallest header that fits from the first size class that has
+  // one. Scans whole free lists, but leaves the fewest unusable leftovers.
+  FSTD_ALLOC_FIT_BEST,
+  // Two-level segregated fit: rounds the request up to the next size class
+  // so any header found through the bitmaps fits. Alloc and free are O(1)
+  // with a hard upper bound, at the cost of slightly more fragmentation.
+  FSTD_ALLOC_FIT_TLSF,
+} fstd_alloc_fit_t;
+
+typedef enum fstd_alloc_storage_t {
+  FSTD_ALLOC_STORAGE_MALLOC,
+  // Blocks are mapped directly from the OS, rounding the block size up to
+  // the page size.
+  FSTD_ALLOC_STORAGE_MAP,
+  // Like FSTD_ALLOC_STORAGE_MAP, rounding up to FSTD_ALLOC_HUGE_PAGE_SIZE
+  // and backing blocks with huge pages: explicit ones (MAP_HUGETLB) if the
+  // system has them reserved, transparent ones (MADV_HUGEPAGE) otherwise.
+  FSTD_ALLOC_STORAGE_HUGE_PAGES,
+} fstd_alloc_storage_t;
+
+#ifndef FSTD_ALLOC_HUGE_PAGE_SIZE
+#define FSTD_ALLOC_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#endif
+
+typedef struct fstd_allocator_options_t {
+  // Rounded up to FSTD__ALLOC_ALIGNMENT (or pages, see storage) and capped
+  // below 4 GiB
+  size_t block_size;
+  // When bigger than block_size, every new block is twice the size of the
+  // last one up to this, so the block count grows logarithmically with the
+  // heap. Rounded and capped like block_size, and ignored with aligned_blocks.
+  size_t max_block_size;
+  fstd_alloc_fit_t fit;
+  // Allocations bigger than this get their own mapping. 0 (or anything that
+  // doesn't fit in a block) means only the ones that don't fit in a block.
+  size_t large_threshold;
+  // Once a block has been empty for this many frees its pages are given back
+  // to the OS (the block itself is kept). 0 disables it.
+  size_t decommit_after_frees;
+  fstd_alloc_storage_t storage;
+  // Rounds block_size up to a power of two and maps every block at a
+  // multiple of it, so the block of any pointer can be found by masking its
+  // address. Blocks are always mapped, even with FSTD_ALLOC_STORAGE_MALLOC.
+  bool aligned_blocks;
+  // Allocations of up to this many bytes (at most FSTD_ALLOC_SLAB_MAX_SIZE)
+  // with the default alignment come from slabs. 0 disables them. Frees then
+  // look every pointer up in a table of slabs, which is what tells slots
+  // apart from allocations with a header.
+  size_t slab_max_size;
+} fstd_allocator_options_t;
+
+// Per-call counters, only kept when FSTD_ALLOC_STATS is defined (for every
+// file that includes this header).
+typedef struct fstd_allocator_counters_t {
+  size_t allocs; // Includes the allocations realloc makes when moving
+  size_t reallocs;
+  size_t reallocs_in_place; // Reallocs that didn't need to copy
+  size_t frees; // Includes the frees realloc makes when moving
+  size_t large_allocs;
+  size_t blocks_added;
+  size_t blocks_decommitted; // Empty blocks whose pages were given back
+  size_t live_bytes;
+  size_t peak_bytes; // Highest live_bytes so far
+} fstd_allocator_counters_t;
+
 typedef struct fstd_allocator_t {
   fstd_alloc_block_t base_block;
   fstd_alloc_block_t *last_block;
-  size_t block_size;
+  size_t block_size; // Size of the first block
+  size_t max_block_size;
+  fstd_alloc_fit_t fit;
+  fstd_alloc_storage_t storage;
+  bool aligned_blocks;
+  size_t large_threshold;
+  fstd_alloc_large_t *large_list;
+  size_t decommit_after_frees;
+  size_t free_count;
+  fstd_alloc_header_t *rover; // Free header FSTD_ALLOC_FIT_NEXT tries first
+  size_t fl_bitmap; // Bit `n` is set when sl_bitmaps[n] is not zero
+  uint32_t sl_bitmaps[FSTD__ALLOC_FL_COUNT];
+  fstd_alloc_header_t *free_lists[FSTD__ALLOC_FL_COUNT][FSTD__ALLOC_SL_COUNT];
+  size_t slab_max_size;
+  fstd_alloc_slab_t *slabs[FSTD__ALLOC_SLAB_CLASS_COUNT]; // With free slots
+  size_t slab_count;
+  // Open addressing set of every slab, with a power of two capacity
+  fstd_alloc_slab_t **slab_table;
+  size_t slab_table_capacity;
+#ifdef FSTD_ALLOC_STATS
+  fstd_allocator_counters_t counters;
+#endif
+#ifdef FSTD_ALLOC_TRACE
+  FILE *trace_file;
+  uint64_t trace_time; // Of the latest record, in nanoseconds
+#endif
 } fstd_allocator_t;
 
+typedef struct fstd_allocator_stats_t {
+  size_t block_count;
+  size_t block_bytes;
+  size_t large_count;
+  size_t large_bytes; // Size of the mappings of large allocations
+  size_t slab_count;
+  size_t slab_bytes;
+  size_t live_count;
+  // Bytes usable by live allocations, large ones and slab slots included
+  size_t live_bytes;
+  size_t overhead_bytes; // Bytes of blocks taken by headers and padding
+  size_t free_count; // Free chunks in blocks
+  size_t free_bytes; // Bytes of free chunks, their headers included
+  size_t largest_free; // Biggest allocation a free chunk can take
+  // Live allocations and free chunks counted by the highest set bit of
+  // their size, which is their index
+  size_t live_histogram[FSTD__ALLOC_FL_COUNT];
+  size_t free_histogram[FSTD__ALLOC_FL_COUNT];
+  fstd_allocator_counters_t counters; // Zeroes without FSTD_ALLOC_STATS
+} fstd_allocator_stats_t;
+
 void fstd_allocator_init(fstd_allocator_t *allocator, size_t block_size);
 
+void fstd_allocator_init_with_options(
+    fstd_allocator_t *allocator, const fstd_allocator_options_t *options);
+
 void fstd_allocator_destroy(fstd_allocator_t *allocator);
 
 void *fstd_alloc(fstd_allocator_t *allocator, size_t size);
 
 void *fstd_realloc(fstd_allocator_t *allocator, void *ptr, size_t size);
 
+// `align` must be a power of two. Alignments up to FSTD__ALLOC_ALIGNMENT are
+// what fstd_alloc already guarantees.
+void *
+fstd_alloc_aligned(fstd_allocator_t *allocator, size_t size, size_t align);
+
+void *fstd_realloc_aligned(
+    fstd_allocator_t *allocator, void *ptr, size_t size, size_t align);
+
 void fstd_free(fstd_allocator_t *allocator, void *ptr);
 
+// Allocates `count` objects of `size` bytes into `ptrs`, carving as many as
+// possible out of each free header found. Returns how many were allocated,
+// which is only less than `count` when out of memory.
+size_t fstd_alloc_batch(
+    fstd_allocator_t *allocator, size_t size, size_t count, void **ptrs);
+
+// Frees `count` allocations, merging neighbours once all of them are free
+// instead of after each one.
+void fstd_free_batch(fstd_allocator_t *allocator, void **ptrs, size_t count);
+
+// Frees slabs and blocks that have no allocations left, except for the first
+// `keep_bytes` worth of them, and returns the number of bytes released.
+// The first block can't be freed, so its whole pages are given back to the OS
+// instead, unless that was already done since it was last used.
+size_t fstd_allocator_trim(fstd_allocator_t *allocator, size_t keep_bytes);
+
+// Walks every block, so it's meant for diagnostics rather than hot paths.
+void fstd_allocator_stats(
+    fstd_allocator_t *allocator, fstd_allocator_stats_t *stats);
+
+/*
+ * Allocation traces. When FSTD_ALLOC_TRACE is defined (for every file that
+ * includes this header), fstd_allocator_trace makes an allocator write every
+ * allocation, reallocation and free to a file, so the allocation pattern of
+ * a real program can be replayed offline (see benchmarks/alloc_replay.c).
+ *
+ * A trace starts with FSTD_ALLOC_TRACE_MAGIC, followed by records made of an
+ * fstd_alloc_trace_op_t byte and then LEB128 varints:
+ *   ALLOC:   time, size, log2(align), ptr
+ *   REALLOC: time, old_ptr, size, log2(align), ptr
+ *   FREE:    time, ptr
+ * `time` is the number of nanoseconds since the previous record. Pointers
+ * are stored as their address divided by 16, which identifies an allocation
+ * until it is freed. Batch calls are written as one record per pointer.
+ */
+#define FSTD_ALLOC_TRACE_MAGIC "FSTDTRC1"
+#define FSTD_ALLOC_TRACE_MAGIC_SIZE 8
+
+typedef enum fstd_alloc_trace_op_t {
+  FSTD_ALLOC_TRACE_ALLOC = 1,
+  FSTD_ALLOC_TRACE_REALLOC = 2,
+  FSTD_ALLOC_TRACE_FREE = 3,
+} fstd_alloc_trace_op_t;
+
+typedef struct fstd_alloc_trace_record_t {
+  fstd_alloc_trace_op_t op;
+  uint64_t time; // Nanoseconds since the previous record
+  uint64_t old_ptr; // Pointer given to realloc, which can be 0
+  uint64_t ptr; // Pointer returned by alloc or realloc, or given to free
+  uint64_t size;
+  uint64_t align;
+} fstd_alloc_trace_record_t;
+
+// Decodes the record at `*cursor` and moves it past the record. Returns false,
+// leaving `*cursor` alone, when there are no records left or the next one is
+// cut short or invalid.
+bool fstd_alloc_trace_read(
+    const uint8_t **cursor,
+    const uint8_t *end,
+    fstd_alloc_trace_record_t *record);
+
+#ifdef FSTD_ALLOC_TRACE
+// Starts writing records to `file`, which must have been opened in binary
+// mode, or stops when `file` is NULL. Writes the magic when `file` is empty.
+void fstd_allocator_trace(fstd_allocator_t *allocator, FILE *file);
+#endif
+
+/*
+ * Allocator for a single thread of a multi-threaded program. Each thread
+ * allocates from its own heap without taking any locks, and memory can be
+ * freed from any thread: frees of memory owned by another heap are pushed
+ * onto that heap's remote free list (a lock-free multi-producer,
+ * single-consumer stack), which its owner drains on its next allocation.
+ *
+ * Heaps use aligned blocks of FSTD_ALLOC_HEAP_BLOCK_SIZE bytes so the owner
+ * of a pointer can be found from its address. A heap must only be destroyed
+ * once no other thread is going to free its memory.
+ */
+#ifndef FSTD_ALLOC_HEAP_BLOCK_SIZE
+#define FSTD_ALLOC_HEAP_BLOCK_SIZE (4 * 1024 * 1024)
+#endif
+
+typedef struct fstd_heap_t {
+  fstd_allocator_t allocator;
+  void *remote_frees; // Only accessed atomically
+} fstd_heap_t;
+
+void fstd_heap_init(fstd_heap_t *heap);
+
+// block_size, aligned_blocks and slab_max_size are ignored.
+void fstd_heap_init_with_options(
+    fstd_heap_t *heap, const fstd_allocator_options_t *options);
+
+void fstd_heap_destroy(fstd_heap_t *heap);
+
+void *fstd_heap_alloc(fstd_heap_t *heap, size_t size);
+
+void *fstd_heap_realloc(fstd_heap_t *heap, void *ptr, size_t size);
+
+// `heap` is the calling thread's heap, which doesn't need to own `ptr`.
+void fstd_heap_free(fstd_heap_t *heap, void *ptr);
+
+// Frees everything other threads have handed back to this heap so far.
+// fstd_heap_alloc does this on its own.
+void fstd_heap_collect(fstd_heap_t *heap);
+
+/*
+ * Linear (bump) allocator over the same chained blocks. Individual
+ * allocations can't be freed: memory is released in bulk with
+ * fstd_arena_rollback or fstd_arena_reset, which keep the blocks around for
+ * reuse until fstd_arena_destroy. Allocations bigger than the block size get
+ * a block of their own.
+ */
+typedef struct fstd_arena_t {
+  fstd_alloc_block_t base_block;
+  fstd_alloc_block_t *current_block;
+  size_t offset; // Bytes used in current_block
+  size_t block_size;
+} fstd_arena_t;
+
+typedef struct fstd_arena_mark_t {
+  fstd_alloc_block_t *block;
+  size_t offset;
+} fstd_arena_mark_t;
+
+void fstd_arena_init(fstd_arena_t *arena, size_t block_size);
+
+void fstd_arena_destroy(fstd_arena_t *arena);
+
+void *fstd_arena_alloc(fstd_arena_t *arena, size_t size);
+
+fstd_arena_mark_t fstd_arena_mark(fstd_arena_t *arena);
+
+// Frees everything allocated since `mark` was taken.
+void fstd_arena_rollback(fstd_arena_t *arena, fstd_arena_mark_t mark);
+
+// Frees everything allocated in the arena.
+void fstd_arena_reset(fstd_arena_t *arena);
+
+/*
+ * Scratch allocator for strictly nested lifetimes, on top of an arena.
+ * Nothing is stored per allocation: fstd_stack_pop_frame releases everything
+ * allocated since the matching fstd_stack_push_frame, and fstd_stack_free
+ * only takes the topmost allocation. Frames are kept in the stack itself.
+ */
+typedef struct fstd__stack_frame_t {
+  struct fstd__stack_frame_t *prev;
+  fstd_arena_mark_t mark;
+} fstd__stack_frame_t;
+
+typedef struct fstd_stack_allocator_t {
+  fstd_arena_t arena;
+  fstd__stack_frame_t *frame; // Innermost frame, NULL when there is none
+} fstd_stack_allocator_t;
+
+void fstd_stack_allocator_init(
+    fstd_stack_allocator_t *stack, size_t block_size);
+
+void fstd_stack_allocator_destroy(fstd_stack_allocator_t *stack);
+
+void *fstd_stack_alloc(fstd_stack_allocator_t *stack, size_t size);
+
+// `ptr` must be the topmost allocation that is still live, and must have
+// been made in the innermost frame.
+void fstd_stack_free(fstd_stack_allocator_t *stack, void *ptr);
+
+// Returns false when out of memory, in which case no frame was pushed.
+bool fstd_stack_push_frame(fstd_stack_allocator_t *stack);
+
+// Frees everything allocated since the innermost frame was pushed.
+void fstd_stack_pop_frame(fstd_stack_allocator_t *stack);
+
+/*
+ * Allocator interface for containers, so they can take their memory from
+ * libc, an fstd_allocator_t, a heap or an arena. `realloc` and `free` are
+ * given the size the allocation was made with, which an arena needs to copy
+ * and other allocators are free to ignore.
+ */
+typedef struct fstd_alloc_interface_t {
+  void *(*alloc)(void *ctx, size_t size);
+  void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size);
+  void (*free)(void *ctx, void *ptr, size_t size);
+  void *ctx;
+} fstd_alloc_interface_t;
+
+fstd_alloc_interface_t fstd_alloc_interface_libc(void);
+
+fstd_alloc_interface_t
+fstd_alloc_interface_allocator(fstd_allocator_t *allocator);
+
+fstd_alloc_interface_t fstd_alloc_interface_heap(fstd_heap_t *heap);
+
+// Frees do nothing: the memory goes away all at once with fstd_arena_reset or
+// fstd_arena_destroy. Reallocating the latest allocation grows it in place
+// when the current block has room.
+fstd_alloc_interface_t fstd_alloc_interface_arena(fstd_arena_t *arena);
+
+// Like the arena one, except that freeing the topmost allocation of the
+// current block gives it back.
+fstd_alloc_interface_t
+fstd_alloc_interface_stack(fstd_stack_allocator_t *stack);
+
 #ifdef FSTD_ALLOC_IMPLEMENTATION
 
 #include <assert.h>
@@ -59,198 +491,2374 @@ void fstd_free(fstd_allocator_t *allocator, void *ptr);
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FSTD__ALLOC_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define FSTD__ALLOC_VIRTUALALLOC
+#include <windows.h>
+#endif
+
+#if defined(FSTD_ALLOC_TRACE) && !defined(_WIN32)
+#include <time.h>
+#endif
+
 #define FSTD__HEADER_ADDR(header)                                              \
   (((uint8_t *)header) + sizeof(fstd_alloc_header_t))
 
-static inline void header_init(
-    fstd_alloc_header_t *header, size_t size, fstd_alloc_header_t *prev,
-    fstd_alloc_header_t *next) {
-  header->prev = prev;
-  header->next = next;
-  header->size = size;
-  header->used = false;
+#define FSTD__HEADER_LINKS(header)                                             \
+  ((fstd__alloc_free_links_t *)FSTD__HEADER_ADDR(header))
+
+// Free headers keep their free list links and their boundary tag in their
+// (unused) payload, so no header can be smaller than this.
+#define FSTD__ALLOC_MIN_SIZE                                                   \
+  FSTD_ALLOC_CHUNK_SIZE(sizeof(fstd__alloc_free_links_t) + sizeof(uint32_t))
+
+// Worst case extra bytes header_align needs to align a payload to `align`
+#define FSTD__ALLOC_ALIGN_PADDING(align)                                       \
+  (FSTD__ALLOC_MIN_SIZE + (align) - FSTD__ALLOC_ALIGNMENT)
+
+// Blocks start with this much padding so the first payload is aligned
+#define FSTD__ALLOC_BLOCK_PADDING                                              \
+  (FSTD__ALLOC_ALIGNMENT - sizeof(fstd_alloc_header_t))
+
+typedef struct fstd__alloc_free_links_t {
+  fstd_alloc_header_t *prev_free;
+  fstd_alloc_header_t *next_free;
+} fstd__alloc_free_links_t;
+
+// Payload of a free header that spans its whole block
+typedef struct fstd__alloc_empty_block_t {
+  fstd__alloc_free_links_t links;
+  size_t empty_since; // free_count when it became empty, or SIZE_MAX
+} fstd__alloc_empty_block_t;
+
+#define FSTD__HEADER_EMPTY_BLOCK(header)                                       \
+  ((fstd__alloc_empty_block_t *)FSTD__HEADER_ADDR(header))
+
+// Index of the highest set bit. `x` must not be zero.
+static inline uint32_t fstd__alloc_fls(size_t x) {
+  assert(x != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return (uint32_t)index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, x);
+  return (uint32_t)index;
+#else
+  return (uint32_t)(63 - __builtin_clzll((unsigned long long)x));
+#endif
 }
 
-static inline void header_merge_if_necessary(fstd_alloc_header_t *header) {
-  assert(header != NULL);
-  assert(!header->used);
+// Index of the lowest set bit. `x` must not be zero.
+static inline uint32_t fstd__alloc_ffs(size_t x) {
+  assert(x != 0);
+#if defined(_MSC_VER) && defined(_WIN64)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (uint32_t)index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, x);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+// Header size (header included) for an allocation of `size` bytes
+static inline size_t fstd__alloc_chunk_size(size_t size) {
+  return FSTD_ALLOC_CHUNK_SIZE(size);
+}
+
+// Bytes from this header to the next one
+static inline size_t header_size(const fstd_alloc_header_t *header) {
+  return header->size & ~FSTD__HEADER_FLAGS;
+}
+
+static inline bool header_used(const fstd_alloc_header_t *header) {
+  return (header->size & FSTD__HEADER_USED) != 0;
+}
+
+// Next header, which is the block's end marker (size 0) after the last one
+static inline fstd_alloc_header_t *header_next(fstd_alloc_header_t *header) {
+  return (fstd_alloc_header_t *)((uint8_t *)header + header_size(header));
+}
+
+// Previous header, which must be free
+static inline fstd_alloc_header_t *header_prev(fstd_alloc_header_t *header) {
+  assert(!(header->size & FSTD__HEADER_PREV_USED));
+  uint32_t prev_size = ((uint32_t *)header)[-1];
+  return (fstd_alloc_header_t *)((uint8_t *)header - prev_size);
+}
+
+// Whether a free header spans its whole block
+static inline bool header_is_block(fstd_alloc_header_t *header) {
+  return (header->size & FSTD__HEADER_FIRST) &&
+         header_size(header_next(header)) == 0;
+}
+
+// Marks a header free with `size` bytes, writing its boundary tag
+static inline void header_set_free(fstd_alloc_header_t *header, size_t size) {
+  header->size = (uint32_t)size |
+                 (header->size & (FSTD__HEADER_PREV_USED | FSTD__HEADER_FIRST));
+  ((uint32_t *)header_next(header))[-1] = (uint32_t)size;
+  header_next(header)->size &= ~FSTD__HEADER_PREV_USED;
+}
+
+static inline void header_set_used(fstd_alloc_header_t *header) {
+  header->size |= FSTD__HEADER_USED;
+  header_next(header)->size |= FSTD__HEADER_PREV_USED;
+}
+
+// Size class of a header of `size` bytes.
+static inline void bin_index(size_t size, uint32_t *fl, uint32_t *sl) {
+  assert(size >= FSTD__ALLOC_SL_COUNT);
+  *fl = fstd__alloc_fls(size);
+  *sl = (uint32_t)(size >> (*fl - FSTD__ALLOC_SL_LOG2)) ^ FSTD__ALLOC_SL_COUNT;
+}
+
+// Every free header goes through here, so this is where a block becomes
+// empty and starts counting towards decommit_after_frees
+static inline void
+bin_insert(fstd_allocator_t *allocator, fstd_alloc_header_t *header) {
+  assert(!header_used(header));
+  uint32_t fl, sl;
+  bin_index(header_size(header), &fl, &sl);
+  fstd__alloc_free_links_t *links = FSTD__HEADER_LINKS(header);
+
+  if (header_is_block(header)) {
+    FSTD__HEADER_EMPTY_BLOCK(header)->empty_since = allocator->free_count;
+  }
+
+  links->prev_free = NULL;
+  links->next_free = allocator->free_lists[fl][sl];
+  if (links->next_free != NULL) {
+    FSTD__HEADER_LINKS(links->next_free)->prev_free = header;
+  }
+
+  allocator->free_lists[fl][sl] = header;
+  allocator->sl_bitmaps[fl] |= (uint32_t)1 << sl;
+  allocator->fl_bitmap |= (size_t)1 << fl;
+}
+
+static inline void
+bin_remove(fstd_allocator_t *allocator, fstd_alloc_header_t *header) {
+  assert(!header_used(header));
+  uint32_t fl, sl;
+  bin_index(header_size(header), &fl, &sl);
+  fstd__alloc_free_links_t *links = FSTD__HEADER_LINKS(header);
+
+  if (links->prev_free != NULL) {
+    FSTD__HEADER_LINKS(links->prev_free)->next_free = links->next_free;
+  } else {
+    assert(allocator->free_lists[fl][sl] == header);
+    allocator->free_lists[fl][sl] = links->next_free;
+    if (links->next_free == NULL) {
+      allocator->sl_bitmaps[fl] &= ~((uint32_t)1 << sl);
+      if (allocator->sl_bitmaps[fl] == 0) {
+        allocator->fl_bitmap &= ~((size_t)1 << fl);
+      }
+    }
+  }
 
-  if (header->prev != NULL && !header->prev->used) {
-    header->prev->next = header->next;
-    header->prev->size += header->size + sizeof(fstd_alloc_header_t);
-    header = header->prev;
+  if (links->next_free != NULL) {
+    FSTD__HEADER_LINKS(links->next_free)->prev_free = links->prev_free;
   }
 
-  if (header->next != NULL && !header->next->used) {
-    header->size += header->next->size + sizeof(fstd_alloc_header_t);
-    header->next = header->next->next;
+  if (allocator->rover == header) {
+    allocator->rover = NULL;
   }
 }
 
-static inline void block_init(fstd_alloc_block_t *block, size_t block_size) {
-  assert(block_size > sizeof(fstd_alloc_header_t));
-  block->storage = (uint8_t *)malloc(block_size);
-  block->first_header = (fstd_alloc_header_t *)block->storage;
-  header_init(
-      block->first_header, block_size - sizeof(fstd_alloc_header_t), NULL,
-      NULL);
-  block->next = NULL;
-  block->prev = NULL;
+// Head of the first non-empty size class at or above (fl, sl), or NULL.
+static inline fstd_alloc_header_t *
+bin_first_from(fstd_allocator_t *allocator, uint32_t fl, uint32_t sl) {
+  uint32_t sl_map = 0;
+  if (sl < FSTD__ALLOC_SL_COUNT) {
+    sl_map = allocator->sl_bitmaps[fl] & (~(uint32_t)0 << sl);
+  }
+
+  if (sl_map == 0) {
+    if (fl + 1 >= FSTD__ALLOC_FL_COUNT) {
+      return NULL;
+    }
+    size_t fl_map = allocator->fl_bitmap & (~(size_t)0 << (fl + 1));
+    if (fl_map == 0) {
+      return NULL;
+    }
+    fl = fstd__alloc_ffs(fl_map);
+    sl_map = allocator->sl_bitmaps[fl];
+  }
+
+  return allocator->free_lists[fl][fstd__alloc_ffs(sl_map)];
 }
 
-static inline void block_destroy(fstd_alloc_block_t *block) {
-  if (block == NULL) {
-    return;
+// Merges a free header that is not in any bin with its free neighbours,
+// which are taken out of their bins. Returns the resulting header.
+static inline fstd_alloc_header_t *header_merge_if_necessary(
+    fstd_allocator_t *allocator, fstd_alloc_header_t *header) {
+  assert(header != NULL);
+  assert(!header_used(header));
+
+  size_t size = header_size(header);
+
+  fstd_alloc_header_t *next = header_next(header);
+  if (!header_used(next)) {
+    bin_remove(allocator, next);
+    size += header_size(next);
   }
 
-  block_destroy(block->next);
-  if (block->next != NULL) {
-    free(block->next);
+  if (!(header->size & FSTD__HEADER_PREV_USED)) {
+    header = header_prev(header);
+    bin_remove(allocator, header);
+    size += header_size(header);
   }
 
-  free(block->storage);
+  header_set_free(header, size);
+  return header;
 }
 
-void fstd_allocator_init(fstd_allocator_t *allocator, size_t block_size) {
-  allocator->block_size = block_size;
+// Shrinks a used header to `size` bytes, turning the rest into a new free
+// header if there is room for one.
+static inline void header_split_if_possible(
+    fstd_allocator_t *allocator, fstd_alloc_header_t *header, size_t size) {
+  if (header_size(header) < size + FSTD__ALLOC_MIN_SIZE) {
+    return;
+  }
 
-  block_init(&allocator->base_block, block_size);
+  // @NOTE: insert new header after the allocation
+  fstd_alloc_header_t *new_header =
+      (fstd_alloc_header_t *)((uint8_t *)header + size);
+  new_header->size =
+      (uint32_t)(header_size(header) - size) | FSTD__HEADER_PREV_USED;
+  header->size = (uint32_t)size | (header->size & FSTD__HEADER_FLAGS);
 
-  allocator->last_block = &allocator->base_block;
+  header_set_free(new_header, header_size(new_header));
+  new_header = header_merge_if_necessary(allocator, new_header);
+  bin_insert(allocator, new_header);
+  allocator->rover = new_header;
 }
 
-void fstd_allocator_destroy(fstd_allocator_t *allocator) {
-  block_destroy(&allocator->base_block);
+static inline size_t fstd__alloc_page_size(void) {
+#if defined(FSTD__ALLOC_MMAP)
+  return (size_t)sysconf(_SC_PAGESIZE);
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (size_t)info.dwPageSize;
+#else
+  return 4096;
+#endif
 }
 
-void *fstd_alloc(fstd_allocator_t *allocator, size_t size) {
-  if (size > allocator->block_size - sizeof(fstd_alloc_header_t)) {
+// Maps `size` bytes (a multiple of the page size) of zeroed memory.
+static inline void *fstd__alloc_map(size_t size) {
+#if defined(FSTD__ALLOC_MMAP)
+  void *ptr = mmap(
+      NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return ptr == MAP_FAILED ? NULL : ptr;
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+  return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  return calloc(1, size);
+#endif
+}
+
+static inline void fstd__alloc_unmap(void *ptr, size_t size) {
+#if defined(FSTD__ALLOC_MMAP)
+  munmap(ptr, size);
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+  (void)size;
+  VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+  (void)size;
+  free(ptr);
+#endif
+}
+
+// Maps `size` bytes (a multiple of the page size) starting at a multiple of
+// `align`, a power of two bigger than the page size.
+static inline void *fstd__alloc_map_aligned(size_t size, size_t align) {
+#if defined(FSTD__ALLOC_MMAP)
+  // Over-map and unmap what sticks out on either side
+  size_t mapping_size = size + align;
+  uint8_t *mapping = (uint8_t *)fstd__alloc_map(mapping_size);
+  if (mapping == NULL) {
     return NULL;
   }
 
-  fstd_alloc_header_t *best_header = NULL;
-  fstd_alloc_block_t *block = allocator->last_block;
-  bool can_insert_new_header = false;
-
-  while (block != NULL) {
-    fstd_alloc_header_t *header = block->first_header;
-    while (header != NULL) {
-      if (!header->used && header->size >= size) {
-        best_header = header;
-
-        size_t padding = 0;
-        size_t size_to_pad =
-            ((uintptr_t)header) + sizeof(fstd_alloc_header_t) + size;
-        if (size_to_pad % FSTD__ALLOC_ALIGNMENT != 0) {
-          padding =
-              FSTD__ALLOC_ALIGNMENT - (size_to_pad % FSTD__ALLOC_ALIGNMENT);
-        }
+  uintptr_t start =
+      ((uintptr_t)mapping + align - 1) & ~(uintptr_t)(align - 1);
+  size_t head = start - (uintptr_t)mapping;
+  if (head > 0) {
+    munmap(mapping, head);
+  }
+  munmap((uint8_t *)start + size, mapping_size - head - size);
+  return (void *)start;
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+  // Only whole regions can be released, so find an aligned address in a
+  // bigger reservation and map there once it's released. Another thread can
+  // take the address in between, hence the retries.
+  for (int i = 0; i < 8; i++) {
+    uint8_t *mapping =
+        (uint8_t *)VirtualAlloc(NULL, size + align, MEM_RESERVE, PAGE_NOACCESS);
+    if (mapping == NULL) {
+      return NULL;
+    }
 
-        can_insert_new_header =
-            (header->size >= sizeof(fstd_alloc_header_t) + size + padding);
-        break;
-      }
+    uintptr_t start =
+        ((uintptr_t)mapping + align - 1) & ~(uintptr_t)(align - 1);
+    VirtualFree(mapping, 0, MEM_RELEASE);
 
-      header = header->next;
+    void *ptr = VirtualAlloc(
+        (void *)start, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (ptr != NULL) {
+      return ptr;
     }
+  }
+  return NULL;
+#else
+  (void)size;
+  (void)align;
+  return NULL;
+#endif
+}
 
-    if (best_header != NULL) {
-      break;
+// Maps `size` bytes (a multiple of `align`) backed by huge pages, falling
+// back to regular pages. `align` is a power of two no smaller than
+// FSTD_ALLOC_HUGE_PAGE_SIZE.
+static inline void *fstd__alloc_map_huge(size_t size, size_t align) {
+  // Explicit huge pages are only aligned to their own size
+  if (align == FSTD_ALLOC_HUGE_PAGE_SIZE) {
+#if defined(FSTD__ALLOC_MMAP) && defined(MAP_HUGETLB)
+    void *ptr = mmap(
+        NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      return ptr;
     }
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+    // Needs SeLockMemoryPrivilege
+    void *ptr = VirtualAlloc(
+        NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (ptr != NULL) {
+      return ptr;
+    }
+#endif
+  }
 
-    block = block->prev;
+#if defined(FSTD__ALLOC_MMAP)
+  // Transparent huge pages need the storage to start on a huge page boundary
+  void *ptr = fstd__alloc_map_aligned(size, align);
+#if defined(MADV_HUGEPAGE)
+  if (ptr != NULL) {
+    madvise(ptr, size, MADV_HUGEPAGE);
+  }
+#endif
+  return ptr;
+#else
+  return fstd__alloc_map_aligned(size, align);
+#endif
+}
+
+// Resizes a mapping, moving it if necessary. The kernel can do this without
+// copying on Linux.
+static inline void *
+fstd__alloc_remap(void *ptr, size_t old_size, size_t new_size) {
+#if defined(FSTD__ALLOC_MMAP) && defined(MREMAP_MAYMOVE)
+  void *new_ptr = mremap(ptr, old_size, new_size, MREMAP_MAYMOVE);
+  return new_ptr == MAP_FAILED ? NULL : new_ptr;
+#else
+  void *new_ptr = fstd__alloc_map(new_size);
+  if (new_ptr != NULL) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+    fstd__alloc_unmap(ptr, old_size);
+  }
+  return new_ptr;
+#endif
+}
+
+static inline fstd_alloc_large_t *
+large_from_header(fstd_alloc_header_t *header) {
+  return (fstd_alloc_large_t *)((uint8_t *)header -
+                                offsetof(fstd_alloc_large_t, header));
+}
+
+static inline uint8_t *large_mapping(fstd_alloc_large_t *large) {
+  return (uint8_t *)large - large->mapping_offset;
+}
+
+static inline size_t large_payload_size(fstd_alloc_large_t *large) {
+  return large->mapping_size - large->mapping_offset -
+         sizeof(fstd_alloc_large_t);
+}
+
+// Bytes usable by the allocation behind a used header
+static inline size_t header_payload_size(fstd_alloc_header_t *header) {
+  if (header->size & FSTD__HEADER_LARGE) {
+    return large_payload_size(large_from_header(header));
   }
+  return header_size(header) - sizeof(fstd_alloc_header_t);
+}
 
-  if (best_header == NULL) {
-    fstd_alloc_block_t *new_block =
-        (fstd_alloc_block_t *)malloc(sizeof(fstd_alloc_block_t));
-    block_init(new_block, allocator->block_size);
+#ifdef FSTD_ALLOC_STATS
+#define FSTD__ALLOC_COUNT(allocator, counter) ((allocator)->counters.counter++)
+#else
+#define FSTD__ALLOC_COUNT(allocator, counter) ((void)(allocator))
+#endif
 
-    new_block->prev = allocator->last_block;
+// Adds a new allocation (or NULL) to the live bytes and returns it
+static inline void *stats_add_live(fstd_allocator_t *allocator, void *ptr) {
+#ifdef FSTD_ALLOC_STATS
+  if (ptr != NULL) {
+    fstd_allocator_counters_t *counters = &allocator->counters;
+    counters->live_bytes += header_payload_size(
+        (fstd_alloc_header_t *)((uint8_t *)ptr - sizeof(fstd_alloc_header_t)));
+    if (counters->live_bytes > counters->peak_bytes) {
+      counters->peak_bytes = counters->live_bytes;
+    }
+  }
+#else
+  (void)allocator;
+#endif
+  return ptr;
+}
 
-    allocator->last_block->next = new_block;
-    allocator->last_block = new_block;
+static inline void stats_remove_live(fstd_allocator_t *allocator, void *ptr) {
+#ifdef FSTD_ALLOC_STATS
+  allocator->counters.live_bytes -= header_payload_size(
+      (fstd_alloc_header_t *)((uint8_t *)ptr - sizeof(fstd_alloc_header_t)));
+#else
+  (void)allocator;
+  (void)ptr;
+#endif
+}
 
-    return fstd_alloc(allocator, size);
+static inline uint8_t *trace_put(uint8_t *cursor, uint64_t value) {
+  while (value >= 0x80) {
+    *cursor++ = (uint8_t)(value | 0x80);
+    value >>= 7;
   }
+  *cursor++ = (uint8_t)value;
+  return cursor;
+}
 
-  if (can_insert_new_header) {
-    size_t padding = 0;
-    size_t size_to_pad =
-        ((uintptr_t)best_header) + sizeof(fstd_alloc_header_t) + size;
-    if (size_to_pad % FSTD__ALLOC_ALIGNMENT != 0) {
-      padding = FSTD__ALLOC_ALIGNMENT - (size_to_pad % FSTD__ALLOC_ALIGNMENT);
+static inline bool
+trace_get(const uint8_t **cursor, const uint8_t *end, uint64_t *value) {
+  *value = 0;
+  for (uint32_t shift = 0; shift < 64; shift += 7) {
+    if (*cursor == end) {
+      return false;
+    }
+    uint8_t byte = *(*cursor)++;
+    *value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      return true;
     }
+  }
+  return false;
+}
 
-    // @NOTE: insert new header after the allocation
-    size_t old_size = best_header->size;
-    best_header->size = size + padding;
-    fstd_alloc_header_t *new_header =
-      (fstd_alloc_header_t *) ((uint8_t *)best_header +
-                                     sizeof(fstd_alloc_header_t) +
-                                     best_header->size);
-    header_init(
-        new_header, old_size - best_header->size - sizeof(fstd_alloc_header_t),
-        best_header, best_header->next);
-    best_header->next = new_header;
+bool fstd_alloc_trace_read(
+    const uint8_t **cursor,
+    const uint8_t *end,
+    fstd_alloc_trace_record_t *record) {
+  const uint8_t *next = *cursor;
+  if (next == end) {
+    return false;
+  }
+
+  memset(record, 0, sizeof(*record));
+  record->op = (fstd_alloc_trace_op_t)*next++;
+
+  uint64_t align_log2 = 0;
+  bool ok = trace_get(&next, end, &record->time);
+  switch (record->op) {
+  case FSTD_ALLOC_TRACE_ALLOC:
+    ok = ok && trace_get(&next, end, &record->size) &&
+         trace_get(&next, end, &align_log2) &&
+         trace_get(&next, end, &record->ptr);
+    break;
+  case FSTD_ALLOC_TRACE_REALLOC:
+    ok = ok && trace_get(&next, end, &record->old_ptr) &&
+         trace_get(&next, end, &record->size) &&
+         trace_get(&next, end, &align_log2) &&
+         trace_get(&next, end, &record->ptr);
+    break;
+  case FSTD_ALLOC_TRACE_FREE:
+    ok = ok && trace_get(&next, end, &record->ptr);
+    break;
+  default:
+    ok = false;
+    break;
   }
 
-  best_header->used = true;
+  if (!ok || align_log2 >= 64) {
+    return false;
+  }
 
-  return FSTD__HEADER_ADDR(best_header);
+  record->align = (uint64_t)1 << align_log2;
+  record->old_ptr <<= 4;
+  record->ptr <<= 4;
+  *cursor = next;
+  return true;
 }
 
-void *fstd_realloc(fstd_allocator_t *allocator, void *ptr, size_t size) {
-  if (ptr == NULL) {
-    return fstd_alloc(allocator, size);
+#ifdef FSTD_ALLOC_TRACE
+static inline uint64_t fstd__alloc_now_ns(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 / frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void trace_write(
+    fstd_allocator_t *allocator,
+    fstd_alloc_trace_op_t op,
+    void *old_ptr,
+    void *ptr,
+    size_t size,
+    size_t align) {
+  uint64_t now = fstd__alloc_now_ns();
+  uint8_t record[1 + 10 * 5];
+  uint8_t *cursor = record;
+
+  *cursor++ = (uint8_t)op;
+  cursor = trace_put(cursor, now - allocator->trace_time);
+  if (op == FSTD_ALLOC_TRACE_REALLOC) {
+    cursor = trace_put(cursor, (uintptr_t)old_ptr >> 4);
+  }
+  if (op != FSTD_ALLOC_TRACE_FREE) {
+    cursor = trace_put(cursor, size);
+    cursor = trace_put(cursor, fstd__alloc_fls(align));
   }
+  cursor = trace_put(cursor, (uintptr_t)ptr >> 4);
 
-  fstd_alloc_header_t *header =
-      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
+  fwrite(record, 1, (size_t)(cursor - record), allocator->trace_file);
+  allocator->trace_time = now;
+}
+#endif
 
-  if (header->size >= size) {
-    // Already big enough
-    header->used = true;
-    return ptr;
+// Records a successful allocation and returns it
+static inline void *trace_alloc(
+    fstd_allocator_t *allocator, void *ptr, size_t size, size_t align) {
+#ifdef FSTD_ALLOC_TRACE
+  if (allocator->trace_file != NULL && ptr != NULL) {
+    trace_write(allocator, FSTD_ALLOC_TRACE_ALLOC, NULL, ptr, size, align);
   }
+#else
+  (void)allocator;
+  (void)size;
+  (void)align;
+#endif
+  return ptr;
+}
 
-  fstd_alloc_header_t *next_header = header->next;
-  size_t next_sizes = header->size;
-  while (next_header != NULL && !next_header->used) {
-    if (next_sizes >= size) {
-      break;
-    }
-    next_sizes += sizeof(fstd_alloc_header_t) + next_header->size;
-    next_header = header->next;
+static inline void *trace_realloc(
+    fstd_allocator_t *allocator,
+    void *old_ptr,
+    void *ptr,
+    size_t size,
+    size_t align) {
+#ifdef FSTD_ALLOC_TRACE
+  if (allocator->trace_file != NULL && ptr != NULL) {
+    trace_write(allocator, FSTD_ALLOC_TRACE_REALLOC, old_ptr, ptr, size, align);
   }
+#else
+  (void)allocator;
+  (void)old_ptr;
+  (void)size;
+  (void)align;
+#endif
+  return ptr;
+}
 
-  if (next_sizes >= size) {
-    // Grow header
-    if (next_header->next != NULL) {
-      next_header->next->prev = header;
-    }
-    header->next = next_header->next;
-    header->size = next_sizes;
-    header->used = true;
+static inline void trace_free(fstd_allocator_t *allocator, void *ptr) {
+#ifdef FSTD_ALLOC_TRACE
+  if (allocator->trace_file != NULL) {
+    trace_write(allocator, FSTD_ALLOC_TRACE_FREE, NULL, ptr, 0, 0);
+  }
+#else
+  (void)allocator;
+  (void)ptr;
+#endif
+}
 
-    return ptr;
+// Mapping size needed for `size` bytes aligned to `align`, or 0 on overflow.
+static inline size_t large_mapping_size(size_t size, size_t align) {
+  size_t page_size = fstd__alloc_page_size();
+
+  // Mappings are page aligned, so only bigger alignments need extra room
+  size_t padding = (sizeof(fstd_alloc_large_t) + align - 1) & ~(align - 1);
+  if (align > page_size) {
+    padding += align - page_size;
   }
 
-  void *new_ptr = fstd_alloc(allocator, size);
-  memcpy(new_ptr, ptr, header->size);
+  size_t mapping_size = padding + size;
+  if (mapping_size < size || mapping_size + page_size < mapping_size) {
+    return 0;
+  }
+  return (mapping_size + page_size - 1) & ~(page_size - 1);
+}
 
-  header->used = false;
-  header_merge_if_necessary(header);
+static inline void
+large_link(fstd_allocator_t *allocator, fstd_alloc_large_t *large) {
+  large->prev = NULL;
+  large->next = allocator->large_list;
+  if (large->next != NULL) {
+    large->next->prev = large;
+  }
+  allocator->large_list = large;
+}
 
-  return new_ptr;
+static inline void
+large_unlink(fstd_allocator_t *allocator, fstd_alloc_large_t *large) {
+  if (large->prev != NULL) {
+    large->prev->next = large->next;
+  } else {
+    allocator->large_list = large->next;
+  }
+  if (large->next != NULL) {
+    large->next->prev = large->prev;
+  }
 }
 
-void fstd_free(fstd_allocator_t *allocator, void *ptr) {
-  fstd_alloc_header_t *header =
-      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
-  assert(FSTD__HEADER_ADDR(header) == ptr);
-  header->used = false;
-  header_merge_if_necessary(header);
+static inline fstd_alloc_large_t *large_init(
+    fstd_allocator_t *allocator,
+    uint8_t *mapping,
+    size_t mapping_offset,
+    size_t mapping_size) {
+  fstd_alloc_large_t *large =
+      (fstd_alloc_large_t *)(mapping + mapping_offset);
+  large->mapping_offset = mapping_offset;
+  large->mapping_size = mapping_size;
+  large->owner = allocator;
+  large->header.size =
+      FSTD__HEADER_USED | FSTD__HEADER_PREV_USED | FSTD__HEADER_LARGE;
+  return large;
+}
+
+static inline void *
+large_alloc(fstd_allocator_t *allocator, size_t size, size_t align) {
+  size_t mapping_size = large_mapping_size(size, align);
+  if (mapping_size == 0) {
+    return NULL;
+  }
+
+  uint8_t *mapping = (uint8_t *)fstd__alloc_map(mapping_size);
+  if (mapping == NULL) {
+    return NULL;
+  }
+  FSTD__ALLOC_COUNT(allocator, large_allocs);
+
+  uintptr_t payload = (uintptr_t)mapping + sizeof(fstd_alloc_large_t);
+  payload = (payload + align - 1) & ~(uintptr_t)(align - 1);
+  size_t mapping_offset =
+      payload - sizeof(fstd_alloc_large_t) - (uintptr_t)mapping;
+
+  fstd_alloc_large_t *large =
+      large_init(allocator, mapping, mapping_offset, mapping_size);
+  large_link(allocator, large);
+
+  return FSTD__HEADER_ADDR(&large->header);
+}
+
+static inline void
+large_free(fstd_allocator_t *allocator, fstd_alloc_large_t *large) {
+  large_unlink(allocator, large);
+  fstd__alloc_unmap(large_mapping(large), large->mapping_size);
+}
+
+static inline void *large_realloc(
+    fstd_allocator_t *allocator,
+    fstd_alloc_large_t *large,
+    size_t size,
+    size_t align) {
+  if (align > fstd__alloc_page_size()) {
+    // Remapping only keeps the offset into the page
+    void *new_ptr = large_alloc(allocator, size, align);
+    if (new_ptr != NULL) {
+      size_t copy_size = large_payload_size(large);
+      memcpy(
+          new_ptr,
+          FSTD__HEADER_ADDR(&large->header),
+          copy_size < size ? copy_size : size);
+      large_free(allocator, large);
+    }
+    return new_ptr;
+  }
+
+  // The payload stays where it is in the mapping, which can be further in
+  // than the padding `align` alone would need
+  size_t page_size = fstd__alloc_page_size();
+  size_t mapping_offset = large->mapping_offset;
+  size_t mapping_size = mapping_offset + sizeof(fstd_alloc_large_t) + size;
+  if (mapping_size < size || mapping_size + page_size < mapping_size) {
+    return NULL;
+  }
+  mapping_size = (mapping_size + page_size - 1) & ~(page_size - 1);
+
+  large_unlink(allocator, large);
+
+  uint8_t *mapping = (uint8_t *)fstd__alloc_remap(
+      large_mapping(large), large->mapping_size, mapping_size);
+  if (mapping == NULL) {
+    large_link(allocator, large);
+    return NULL;
+  }
+
+  large = large_init(allocator, mapping, mapping_offset, mapping_size);
+  large_link(allocator, large);
+#if defined(FSTD__ALLOC_MMAP) && defined(MREMAP_MAYMOVE)
+  // Otherwise fstd__alloc_remap copied it
+  FSTD__ALLOC_COUNT(allocator, reallocs_in_place);
+#endif
+
+  return FSTD__HEADER_ADDR(&large->header);
+}
+
+static inline size_t slab_class(size_t size) {
+  return size == 0 ? 0 : (size - 1) / FSTD__ALLOC_ALIGNMENT;
+}
+
+static inline size_t slab_hash(fstd_allocator_t *allocator, void *slab) {
+  uint64_t key = (uint64_t)((uintptr_t)slab / FSTD_ALLOC_SLAB_SIZE);
+  return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) &
+         (allocator->slab_table_capacity - 1);
+}
+
+static inline void
+slab_table_insert(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab) {
+  size_t mask = allocator->slab_table_capacity - 1;
+  size_t index = slab_hash(allocator, slab);
+  while (allocator->slab_table[index] != NULL) {
+    index = (index + 1) & mask;
+  }
+  allocator->slab_table[index] = slab;
+}
+
+// Doubles the table, keeping it at most half full. Returns false when out of
+// memory.
+static inline bool slab_table_grow(fstd_allocator_t *allocator) {
+  fstd_alloc_slab_t **old_table = allocator->slab_table;
+  size_t old_capacity = allocator->slab_table_capacity;
+
+  size_t capacity = old_capacity == 0 ? 16 : old_capacity * 2;
+  fstd_alloc_slab_t **table =
+      (fstd_alloc_slab_t **)calloc(capacity, sizeof(fstd_alloc_slab_t *));
+  if (table == NULL) {
+    return false;
+  }
+
+  allocator->slab_table = table;
+  allocator->slab_table_capacity = capacity;
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_table[i] != NULL) {
+      slab_table_insert(allocator, old_table[i]);
+    }
+  }
+
+  free(old_table);
+  return true;
+}
+
+static inline void
+slab_table_remove(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab) {
+  fstd_alloc_slab_t **table = allocator->slab_table;
+  size_t mask = allocator->slab_table_capacity - 1;
+
+  size_t index = slab_hash(allocator, slab);
+  while (table[index] != slab) {
+    index = (index + 1) & mask;
+  }
+
+  // Shift the rest of the run back over the hole, so lookups never need
+  // tombstones
+  size_t next = index;
+  for (;;) {
+    next = (next + 1) & mask;
+    if (table[next] == NULL) {
+      break;
+    }
+    size_t home = slab_hash(allocator, table[next]);
+    if (((next - home) & mask) >= ((next - index) & mask)) {
+      table[index] = table[next];
+      index = next;
+    }
+  }
+  table[index] = NULL;
+}
+
+// Slab `ptr` is a slot of, or NULL if it's some other allocation
+static inline fstd_alloc_slab_t *
+slab_find(fstd_allocator_t *allocator, void *ptr) {
+  if (allocator->slab_count == 0) {
+    return NULL;
+  }
+
+  fstd_alloc_slab_t *slab =
+      (fstd_alloc_slab_t *)((uintptr_t)ptr &
+                            ~(uintptr_t)(FSTD_ALLOC_SLAB_SIZE - 1));
+
+  size_t mask = allocator->slab_table_capacity - 1;
+  size_t index = slab_hash(allocator, slab);
+  while (allocator->slab_table[index] != NULL) {
+    if (allocator->slab_table[index] == slab) {
+      return slab;
+    }
+    index = (index + 1) & mask;
+  }
+  return NULL;
+}
+
+static inline void
+slab_link(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab) {
+  fstd_alloc_slab_t **list = &allocator->slabs[slab_class(slab->slot_size)];
+  slab->prev = NULL;
+  slab->next = *list;
+  if (*list != NULL) {
+    (*list)->prev = slab;
+  }
+  *list = slab;
+}
+
+static inline void
+slab_unlink(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab) {
+  if (slab->prev != NULL) {
+    slab->prev->next = slab->next;
+  } else {
+    allocator->slabs[slab_class(slab->slot_size)] = slab->next;
+  }
+  if (slab->next != NULL) {
+    slab->next->prev = slab->prev;
+  }
+  slab->prev = NULL;
+  slab->next = NULL;
+}
+
+static inline fstd_alloc_slab_t *
+slab_create(fstd_allocator_t *allocator, size_t slot_size) {
+  if ((allocator->slab_count + 1) * 2 > allocator->slab_table_capacity &&
+      !slab_table_grow(allocator)) {
+    return NULL;
+  }
+
+  fstd_alloc_slab_t *slab = (fstd_alloc_slab_t *)fstd__alloc_map_aligned(
+      FSTD_ALLOC_SLAB_SIZE, FSTD_ALLOC_SLAB_SIZE);
+  if (slab == NULL) {
+    return NULL;
+  }
+
+  slab->prev = NULL;
+  slab->next = NULL;
+  slab->slot_size = (uint32_t)slot_size;
+  slab->slot_count =
+      (uint32_t)((FSTD_ALLOC_SLAB_SIZE - FSTD__ALLOC_SLAB_OVERHEAD) /
+                 slot_size);
+  slab->used_count = 0;
+  slab->hint = 0;
+  fstd_bitset_reset(&slab->used, slab->slot_count);
+
+  slab_table_insert(allocator, slab);
+  allocator->slab_count++;
+  slab_link(allocator, slab);
+
+  return slab;
+}
+
+static inline void
+slab_destroy(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab) {
+  slab_unlink(allocator, slab);
+  slab_table_remove(allocator, slab);
+  allocator->slab_count--;
+  fstd__alloc_unmap(slab, FSTD_ALLOC_SLAB_SIZE);
+}
+
+// Returns NULL when no slab can be mapped, so the caller can fall back to
+// the blocks
+static inline void *slab_alloc(fstd_allocator_t *allocator, size_t size) {
+  fstd_alloc_slab_t *slab = allocator->slabs[slab_class(size)];
+  if (slab == NULL) {
+    slab = slab_create(
+        allocator, (slab_class(size) + 1) * FSTD__ALLOC_ALIGNMENT);
+    if (slab == NULL) {
+      return NULL;
+    }
+  }
+
+  uint32_t index =
+      fstd_bitset_find_zero(&slab->used, slab->hint, slab->slot_count);
+  assert(index < slab->slot_count);
+  fstd_bitset_set(&slab->used, index, true);
+  slab->hint = index + 1;
+
+  slab->used_count++;
+  if (slab->used_count == slab->slot_count) {
+    slab_unlink(allocator, slab);
+  }
+
+#ifdef FSTD_ALLOC_STATS
+  fstd_allocator_counters_t *counters = &allocator->counters;
+  counters->live_bytes += slab->slot_size;
+  if (counters->live_bytes > counters->peak_bytes) {
+    counters->peak_bytes = counters->live_bytes;
+  }
+#endif
+
+  return (uint8_t *)slab + FSTD__ALLOC_SLAB_OVERHEAD +
+         (size_t)index * slab->slot_size;
+}
+
+static inline void
+slab_free(fstd_allocator_t *allocator, fstd_alloc_slab_t *slab, void *ptr) {
+  uint32_t offset = (uint32_t)((uint8_t *)ptr - (uint8_t *)slab) -
+                    (uint32_t)FSTD__ALLOC_SLAB_OVERHEAD;
+  assert(offset % slab->slot_size == 0);
+  uint32_t index = offset / slab->slot_size;
+  assert(fstd_bitset_at(&slab->used, index));
+
+  fstd_bitset_set(&slab->used, index, false);
+  if (index < slab->hint) {
+    slab->hint = index;
+  }
+
+#ifdef FSTD_ALLOC_STATS
+  allocator->counters.live_bytes -= slab->slot_size;
+#endif
+
+  // Empty slabs are kept like empty blocks, until fstd_allocator_trim
+  if (slab->used_count == slab->slot_count) {
+    slab_link(allocator, slab);
+  }
+  slab->used_count--;
+}
+
+// Gives the pages of an empty block back to the OS, and returns how many
+// bytes that was. They read as zeroes when touched again.
+static inline size_t
+block_decommit(fstd_allocator_t *allocator, fstd_alloc_header_t *header) {
+  assert(header_is_block(header) && !header_used(header));
+  FSTD__HEADER_EMPTY_BLOCK(header)->empty_since = SIZE_MAX;
+
+  // Keep the free list links and the boundary tag
+  size_t page_size = fstd__alloc_page_size();
+  uintptr_t start = (uintptr_t)FSTD__HEADER_ADDR(header) +
+                    sizeof(fstd__alloc_empty_block_t);
+  uintptr_t end = (uintptr_t)header_next(header) - sizeof(uint32_t);
+  start = (start + page_size - 1) & ~(uintptr_t)(page_size - 1);
+  end &= ~(uintptr_t)(page_size - 1);
+  if (start >= end) {
+    return 0;
+  }
+  FSTD__ALLOC_COUNT(allocator, blocks_decommitted);
+
+#if defined(FSTD__ALLOC_MMAP)
+  madvise((void *)start, end - start, MADV_DONTNEED);
+#elif defined(FSTD__ALLOC_VIRTUALALLOC)
+  VirtualAlloc((void *)start, end - start, MEM_RESET, PAGE_READWRITE);
+#endif
+  return end - start;
+}
+
+// `align` is 0, or the power of two the storage has to start at a multiple
+// of.
+static inline void block_init_storage(
+    fstd_alloc_block_t *block,
+    size_t block_size,
+    fstd_alloc_storage_t storage,
+    size_t align) {
+  block->storage = NULL;
+  block->size = block_size;
+  block->mapping_size = 0;
+  block->arena_offset = 0;
+
+  if (storage == FSTD_ALLOC_STORAGE_HUGE_PAGES) {
+    size_t huge_align =
+        align > FSTD_ALLOC_HUGE_PAGE_SIZE ? align : FSTD_ALLOC_HUGE_PAGE_SIZE;
+    block->storage = (uint8_t *)fstd__alloc_map_huge(block_size, huge_align);
+  } else if (align != 0) {
+    block->storage = (uint8_t *)fstd__alloc_map_aligned(block_size, align);
+  } else if (storage == FSTD_ALLOC_STORAGE_MAP) {
+    block->storage = (uint8_t *)fstd__alloc_map(block_size);
+  }
+
+  if (block->storage != NULL) {
+    block->mapping_size = block_size;
+  } else if (align == 0) {
+    block->storage = (uint8_t *)malloc(block_size);
+  }
+
+  block->first_header = NULL;
+  block->next = NULL;
+  block->prev = NULL;
+}
+
+// Returns false when out of memory
+static inline bool block_init(
+    fstd_allocator_t *allocator, fstd_alloc_block_t *block, size_t block_size) {
+  assert(block_size >= FSTD_ALLOC_BLOCK_OVERHEAD + FSTD__ALLOC_MIN_SIZE);
+  block_init_storage(
+      block,
+      block_size,
+      allocator->storage,
+      allocator->aligned_blocks ? block_size : 0);
+  if (block->storage == NULL) {
+    return false;
+  }
+
+  // The padding before the first header holds the owner, so it can be found
+  // from any pointer into an aligned block
+  *(fstd_allocator_t **)block->storage = allocator;
+
+  // Used header of size 0 at the end, so nothing merges past it
+  fstd_alloc_header_t *end =
+      (fstd_alloc_header_t *)(block->storage + block_size -
+                              sizeof(fstd_alloc_header_t));
+  end->size = FSTD__HEADER_USED;
+
+  block->first_header =
+      (fstd_alloc_header_t *)(block->storage + FSTD__ALLOC_BLOCK_PADDING);
+  block->first_header->size = FSTD__HEADER_PREV_USED | FSTD__HEADER_FIRST;
+  header_set_free(
+      block->first_header, block_size - FSTD_ALLOC_BLOCK_OVERHEAD);
+  return true;
+}
+
+static inline void block_free_storage(fstd_alloc_block_t *block) {
+  if (block->mapping_size != 0) {
+    fstd__alloc_unmap(block->storage, block->mapping_size);
+  } else {
+    free(block->storage);
+  }
+}
+
+// Frees `block` and the ones after it. Only the first one isn't heap
+// allocated itself.
+static inline void block_destroy(fstd_alloc_block_t *block) {
+  fstd_alloc_block_t *next = block->next;
+  block_free_storage(block);
+
+  while (next != NULL) {
+    block = next;
+    next = block->next;
+    block_free_storage(block);
+    free(block);
+  }
+}
+
+// Moves the start of a free header forward so its payload is aligned to
+// `align`, giving the skipped bytes back as a new free header. The header
+// must be at least FSTD__ALLOC_ALIGN_PADDING(align) bytes bigger than needed.
+static inline fstd_alloc_header_t *header_align(
+    fstd_allocator_t *allocator, fstd_alloc_header_t *header, size_t align) {
+  uintptr_t payload = (uintptr_t)FSTD__HEADER_ADDR(header);
+  if (payload % align == 0) {
+    return header;
+  }
+
+  // The skipped bytes need to fit a header of their own
+  uintptr_t aligned = payload + FSTD__ALLOC_MIN_SIZE;
+  aligned = (aligned + align - 1) & ~(uintptr_t)(align - 1);
+  size_t gap = aligned - payload;
+  assert(header_size(header) >= gap);
+
+  fstd_alloc_header_t *aligned_header =
+      (fstd_alloc_header_t *)(aligned - sizeof(fstd_alloc_header_t));
+  aligned_header->size = (uint32_t)(header_size(header) - gap);
+
+  header_set_free(header, gap);
+  bin_insert(allocator, header);
+  return aligned_header;
+}
+
+// Smallest header of at least `size` bytes in the free list starting at
+// `header`, or NULL.
+static inline fstd_alloc_header_t *
+bin_best_in_list(fstd_alloc_header_t *header, size_t size) {
+  fstd_alloc_header_t *best = NULL;
+  while (header != NULL) {
+    size_t header_bytes = header_size(header);
+    if (header_bytes >= size &&
+        (best == NULL || header_bytes < header_size(best))) {
+      best = header;
+      if (header_bytes == size) {
+        break;
+      }
+    }
+    header = FSTD__HEADER_LINKS(header)->next_free;
+  }
+  return best;
+}
+
+// Finds a free header of at least `size` bytes and takes it out of its bin.
+static inline fstd_alloc_header_t *
+bin_find(fstd_allocator_t *allocator, size_t size) {
+  uint32_t fl, sl;
+  fstd_alloc_header_t *header = NULL;
+
+  switch (allocator->fit) {
+  case FSTD_ALLOC_FIT_TLSF: {
+    // Round up to the next size class, whose headers all fit
+    size += ((size_t)1 << (fstd__alloc_fls(size) - FSTD__ALLOC_SL_LOG2)) - 1;
+    bin_index(size, &fl, &sl);
+    header = bin_first_from(allocator, fl, sl);
+    break;
+  }
+  case FSTD_ALLOC_FIT_BEST: {
+    bin_index(size, &fl, &sl);
+    header = bin_best_in_list(allocator->free_lists[fl][sl], size);
+    if (header == NULL) {
+      // Everything in bigger size classes fits
+      header = bin_best_in_list(bin_first_from(allocator, fl, sl + 1), size);
+    }
+    break;
+  }
+  case FSTD_ALLOC_FIT_NEXT:
+    if (allocator->rover != NULL && header_size(allocator->rover) >= size) {
+      header = allocator->rover;
+      break;
+    }
+    // fallthrough
+  case FSTD_ALLOC_FIT_FIRST: {
+    bin_index(size, &fl, &sl);
+
+    // Headers in the request's own size class may still be too small
+    header = allocator->free_lists[fl][sl];
+    while (header != NULL && header_size(header) < size) {
+      header = FSTD__HEADER_LINKS(header)->next_free;
+    }
+
+    if (header == NULL) {
+      header = bin_first_from(allocator, fl, sl + 1);
+    }
+    break;
+  }
+  }
+
+  if (header != NULL) {
+    bin_remove(allocator, header);
+  }
+  return header;
+}
+
+void fstd_allocator_init(fstd_allocator_t *allocator, size_t block_size) {
+  fstd_allocator_options_t options = {0};
+  options.block_size = block_size;
+  fstd_allocator_init_with_options(allocator, &options);
+}
+
+void fstd_allocator_init_with_options(
+    fstd_allocator_t *allocator, const fstd_allocator_options_t *options) {
+  size_t block_alignment = FSTD__ALLOC_ALIGNMENT;
+  if (options->storage == FSTD_ALLOC_STORAGE_MAP) {
+    block_alignment = fstd__alloc_page_size();
+  } else if (options->storage == FSTD_ALLOC_STORAGE_HUGE_PAGES) {
+    block_alignment = FSTD_ALLOC_HUGE_PAGE_SIZE;
+  }
+
+  // Header sizes are 32 bits
+  size_t size_limit = (size_t)(UINT32_MAX & ~(uint32_t)(block_alignment - 1));
+  size_t block_size = options->block_size;
+  if (block_size > size_limit) {
+    block_size = size_limit;
+  }
+  if (block_size < FSTD_ALLOC_BLOCK_OVERHEAD + FSTD__ALLOC_MIN_SIZE) {
+    block_size = FSTD_ALLOC_BLOCK_OVERHEAD + FSTD__ALLOC_MIN_SIZE;
+  }
+
+  if (options->aligned_blocks) {
+    // Blocks are mapped at a multiple of their (power of two) size
+    if (block_size > (size_t)1 << 31) {
+      block_size = (size_t)1 << 31;
+    }
+    size_t min_alignment = block_alignment > fstd__alloc_page_size()
+                               ? block_alignment
+                               : fstd__alloc_page_size();
+    block_alignment = (size_t)1 << fstd__alloc_fls(block_size);
+    if (block_alignment < block_size) {
+      block_alignment <<= 1;
+    }
+    if (block_alignment < min_alignment) {
+      block_alignment = min_alignment;
+    }
+  }
+
+  allocator->block_size =
+      (block_size + block_alignment - 1) & ~(size_t)(block_alignment - 1);
+
+  allocator->max_block_size = allocator->block_size;
+  if (!options->aligned_blocks &&
+      options->max_block_size > allocator->block_size) {
+    size_t max_block_size = options->max_block_size;
+    if (max_block_size > size_limit) {
+      max_block_size = size_limit;
+    }
+    allocator->max_block_size = (max_block_size + block_alignment - 1) &
+                                ~(size_t)(block_alignment - 1);
+  }
+
+  allocator->fit = options->fit;
+  allocator->storage = options->storage;
+  allocator->aligned_blocks = options->aligned_blocks;
+
+  size_t max_block_alloc = FSTD_ALLOC_MAX_SIZE(allocator->max_block_size);
+  allocator->large_threshold = options->large_threshold;
+  if (allocator->large_threshold == 0 ||
+      allocator->large_threshold > max_block_alloc) {
+    allocator->large_threshold = max_block_alloc;
+  }
+  allocator->large_list = NULL;
+
+  allocator->rover = NULL;
+  allocator->fl_bitmap = 0;
+  memset(allocator->sl_bitmaps, 0, sizeof(allocator->sl_bitmaps));
+  memset(allocator->free_lists, 0, sizeof(allocator->free_lists));
+
+  allocator->slab_max_size = options->slab_max_size;
+  if (allocator->slab_max_size > FSTD_ALLOC_SLAB_MAX_SIZE) {
+    allocator->slab_max_size = FSTD_ALLOC_SLAB_MAX_SIZE;
+  }
+  memset(allocator->slabs, 0, sizeof(allocator->slabs));
+  allocator->slab_count = 0;
+  allocator->slab_table = NULL;
+  allocator->slab_table_capacity = 0;
+
+  allocator->decommit_after_frees = options->decommit_after_frees;
+  allocator->free_count = 0;
+#ifdef FSTD_ALLOC_STATS
+  memset(&allocator->counters, 0, sizeof(allocator->counters));
+#endif
+#ifdef FSTD_ALLOC_TRACE
+  allocator->trace_file = NULL;
+  allocator->trace_time = 0;
+#endif
+
+  bool initialized =
+      block_init(allocator, &allocator->base_block, allocator->block_size);
+  assert(initialized);
+  (void)initialized;
+  bin_insert(allocator, allocator->base_block.first_header);
+  FSTD__HEADER_EMPTY_BLOCK(allocator->base_block.first_header)->empty_since =
+      SIZE_MAX;
+
+  allocator->last_block = &allocator->base_block;
+}
+
+void fstd_allocator_destroy(fstd_allocator_t *allocator) {
+  while (allocator->large_list != NULL) {
+    large_free(allocator, allocator->large_list);
+  }
+
+  for (size_t i = 0; i < allocator->slab_table_capacity; i++) {
+    if (allocator->slab_table[i] != NULL) {
+      fstd__alloc_unmap(allocator->slab_table[i], FSTD_ALLOC_SLAB_SIZE);
+    }
+  }
+  free(allocator->slab_table);
+
+  block_destroy(&allocator->base_block);
+}
+
+// Decommits blocks that have been empty for at least decommit_after_frees
+// frees. Headers spanning a whole block sit in the size classes of the block
+// sizes: block_size doubled any number of times, and max_block_size.
+static inline void decommit_sweep(fstd_allocator_t *allocator) {
+  size_t block_size = allocator->block_size;
+  for (;;) {
+    uint32_t fl, sl;
+    bin_index(block_size - FSTD_ALLOC_BLOCK_OVERHEAD, &fl, &sl);
+
+    fstd_alloc_header_t *header = allocator->free_lists[fl][sl];
+    while (header != NULL) {
+      if (header_is_block(header)) {
+        size_t empty_since = FSTD__HEADER_EMPTY_BLOCK(header)->empty_since;
+        if (empty_since != SIZE_MAX &&
+            allocator->free_count - empty_since >=
+                allocator->decommit_after_frees) {
+          block_decommit(allocator, header);
+        }
+      }
+      header = FSTD__HEADER_LINKS(header)->next_free;
+    }
+
+    if (block_size == allocator->max_block_size) {
+      break;
+    }
+    block_size = block_size <= allocator->max_block_size / 2
+                     ? block_size * 2
+                     : allocator->max_block_size;
+  }
+}
+
+// Adds a new block with room for a header of `size` bytes and returns its
+// only header, which is not in any bin, or NULL when out of memory.
+static inline fstd_alloc_header_t *
+block_add(fstd_allocator_t *allocator, size_t size) {
+  // Twice the last block (more if the header needs it), up to max_block_size
+  size_t block_size = allocator->last_block->size;
+  do {
+    block_size = block_size <= allocator->max_block_size / 2
+                     ? block_size * 2
+                     : allocator->max_block_size;
+  } while (block_size - FSTD_ALLOC_BLOCK_OVERHEAD < size &&
+           block_size < allocator->max_block_size);
+  assert(block_size - FSTD_ALLOC_BLOCK_OVERHEAD >= size);
+
+  fstd_alloc_block_t *new_block =
+      (fstd_alloc_block_t *)malloc(sizeof(fstd_alloc_block_t));
+  if (new_block == NULL) {
+    return NULL;
+  }
+  if (!block_init(allocator, new_block, block_size)) {
+    free(new_block);
+    return NULL;
+  }
+  FSTD__ALLOC_COUNT(allocator, blocks_added);
+
+  new_block->prev = allocator->last_block;
+
+  allocator->last_block->next = new_block;
+  allocator->last_block = new_block;
+
+  return new_block->first_header;
+}
+
+// The public functions below only add tracing to these, so that the calls
+// they make to each other aren't traced twice
+
+static void *allocator_alloc(fstd_allocator_t *allocator, size_t size) {
+  FSTD__ALLOC_COUNT(allocator, allocs);
+
+  // Zero-sized allocations would otherwise end up in a slab with slabs off
+  if (allocator->slab_max_size != 0 && size <= allocator->slab_max_size) {
+    void *ptr = slab_alloc(allocator, size);
+    if (ptr != NULL) {
+      return ptr;
+    }
+  }
+
+  if (size > allocator->large_threshold) {
+    return stats_add_live(
+        allocator, large_alloc(allocator, size, FSTD__ALLOC_ALIGNMENT));
+  }
+
+  size = fstd__alloc_chunk_size(size);
+
+  fstd_alloc_header_t *header = bin_find(allocator, size);
+  if (header == NULL) {
+    header = block_add(allocator, size);
+    if (header == NULL) {
+      return NULL;
+    }
+  }
+
+  header_set_used(header);
+  header_split_if_possible(allocator, header, size);
+
+  return stats_add_live(allocator, FSTD__HEADER_ADDR(header));
+}
+
+static void *allocator_alloc_aligned(
+    fstd_allocator_t *allocator, size_t size, size_t align) {
+  assert(align != 0 && (align & (align - 1)) == 0);
+
+  if (align <= FSTD__ALLOC_ALIGNMENT) {
+    return allocator_alloc(allocator, size);
+  }
+
+  FSTD__ALLOC_COUNT(allocator, allocs);
+
+  if (size > allocator->large_threshold ||
+      align > allocator->max_block_size) {
+    return stats_add_live(allocator, large_alloc(allocator, size, align));
+  }
+
+  size = fstd__alloc_chunk_size(size);
+
+  // Only headers whose payload isn't already aligned need the padding, and
+  // whatever they don't use is given back
+  size_t padded_size = size + FSTD__ALLOC_ALIGN_PADDING(align);
+  if (padded_size > allocator->max_block_size - FSTD_ALLOC_BLOCK_OVERHEAD) {
+    return stats_add_live(
+        allocator,
+        large_alloc(allocator, size - sizeof(fstd_alloc_header_t), align));
+  }
+
+  fstd_alloc_header_t *header = bin_find(allocator, padded_size);
+  if (header == NULL) {
+    header = block_add(allocator, padded_size);
+    if (header == NULL) {
+      return NULL;
+    }
+  }
+
+  header = header_align(allocator, header, align);
+  header_set_used(header);
+  header_split_if_possible(allocator, header, size);
+
+  return stats_add_live(allocator, FSTD__HEADER_ADDR(header));
+}
+
+static void allocator_free(fstd_allocator_t *allocator, void *ptr);
+
+static void *allocator_realloc_aligned(
+    fstd_allocator_t *allocator, void *ptr, size_t size, size_t align) {
+  if (ptr == NULL) {
+    return allocator_alloc_aligned(allocator, size, align);
+  }
+
+  fstd_alloc_slab_t *slab = slab_find(allocator, ptr);
+  if (slab != NULL) {
+    FSTD__ALLOC_COUNT(allocator, reallocs);
+
+    if (size <= slab->slot_size && align <= FSTD__ALLOC_ALIGNMENT) {
+      FSTD__ALLOC_COUNT(allocator, reallocs_in_place);
+      return ptr;
+    }
+
+    void *new_ptr = allocator_alloc_aligned(allocator, size, align);
+    if (new_ptr == NULL) {
+      return NULL;
+    }
+
+    memcpy(new_ptr, ptr, slab->slot_size < size ? slab->slot_size : size);
+    allocator_free(allocator, ptr);
+    return new_ptr;
+  }
+
+  fstd_alloc_header_t *header =
+      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
+
+  bool aligned = ((uintptr_t)ptr & (align - 1)) == 0;
+  bool large = (header->size & FSTD__HEADER_LARGE) != 0;
+
+  FSTD__ALLOC_COUNT(allocator, reallocs);
+
+  if (aligned && large && size > allocator->large_threshold) {
+    // Grows and shrinks without copying where the OS supports it
+    stats_remove_live(allocator, ptr);
+    void *new_ptr =
+        large_realloc(allocator, large_from_header(header), size, align);
+    stats_add_live(allocator, new_ptr != NULL ? new_ptr : ptr);
+    return new_ptr;
+  }
+
+  if (aligned && !large && size <= allocator->large_threshold) {
+    size_t chunk_size = fstd__alloc_chunk_size(size);
+    size_t old_size = header_size(header);
+
+    if (old_size >= chunk_size) {
+      // Shrink, giving back the tail if it's big enough for a header
+      FSTD__ALLOC_COUNT(allocator, reallocs_in_place);
+      stats_remove_live(allocator, ptr);
+      header_split_if_possible(allocator, header, chunk_size);
+      return stats_add_live(allocator, ptr);
+    }
+
+    // Free neighbours are always merged, so there is at most one on each
+    // side to grow into
+    size_t available = old_size;
+    fstd_alloc_header_t *next_header = header_next(header);
+    if (!header_used(next_header)) {
+      available += header_size(next_header);
+    }
+
+    // Growing backwards moves the payload, which has to stay aligned
+    fstd_alloc_header_t *prev_header = NULL;
+    if (available < chunk_size &&
+        !(header->size & FSTD__HEADER_PREV_USED)) {
+      prev_header = header_prev(header);
+      if ((uintptr_t)FSTD__HEADER_ADDR(prev_header) % align == 0) {
+        available += header_size(prev_header);
+      } else {
+        prev_header = NULL;
+      }
+    }
+
+    if (available >= chunk_size) {
+      stats_remove_live(allocator, ptr);
+
+      if (!header_used(next_header)) {
+        bin_remove(allocator, next_header);
+        header->size += (uint32_t)header_size(next_header);
+      }
+
+      if (prev_header != NULL) {
+        bin_remove(allocator, prev_header);
+        prev_header->size += (uint32_t)header_size(header);
+        memmove(
+            FSTD__HEADER_ADDR(prev_header),
+            ptr,
+            old_size - sizeof(fstd_alloc_header_t));
+        header = prev_header;
+        ptr = FSTD__HEADER_ADDR(header);
+      } else {
+        FSTD__ALLOC_COUNT(allocator, reallocs_in_place);
+      }
+
+      header_set_used(header);
+      header_split_if_possible(allocator, header, chunk_size);
+      return stats_add_live(allocator, ptr);
+    }
+  }
+
+  void *new_ptr = allocator_alloc_aligned(allocator, size, align);
+  if (new_ptr == NULL) {
+    return NULL;
+  }
+
+  size_t old_size = header_payload_size(header);
+  memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+  allocator_free(allocator, ptr);
+
+  return new_ptr;
+}
+
+static void allocator_free(fstd_allocator_t *allocator, void *ptr) {
+  fstd_alloc_slab_t *slab = slab_find(allocator, ptr);
+  if (slab != NULL) {
+    FSTD__ALLOC_COUNT(allocator, frees);
+    slab_free(allocator, slab, ptr);
+    return;
+  }
+
+  fstd_alloc_header_t *header =
+      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
+  assert(FSTD__HEADER_ADDR(header) == ptr);
+  assert(header_used(header));
+
+  FSTD__ALLOC_COUNT(allocator, frees);
+  stats_remove_live(allocator, ptr);
+
+  if (header->size & FSTD__HEADER_LARGE) {
+    large_free(allocator, large_from_header(header));
+    return;
+  }
+
+  allocator->free_count++;
+  header_set_free(header, header_size(header));
+  header = header_merge_if_necessary(allocator, header);
+  bin_insert(allocator, header);
+  allocator->rover = header;
+
+  if (allocator->decommit_after_frees != 0 &&
+      allocator->free_count % allocator->decommit_after_frees == 0) {
+    decommit_sweep(allocator);
+  }
+}
+
+void *fstd_alloc(fstd_allocator_t *allocator, size_t size) {
+  return trace_alloc(
+      allocator,
+      allocator_alloc(allocator, size),
+      size,
+      FSTD__ALLOC_ALIGNMENT);
+}
+
+void *
+fstd_alloc_aligned(fstd_allocator_t *allocator, size_t size, size_t align) {
+  return trace_alloc(
+      allocator, allocator_alloc_aligned(allocator, size, align), size, align);
+}
+
+void *fstd_realloc(fstd_allocator_t *allocator, void *ptr, size_t size) {
+  return fstd_realloc_aligned(allocator, ptr, size, FSTD__ALLOC_ALIGNMENT);
+}
+
+void *fstd_realloc_aligned(
+    fstd_allocator_t *allocator, void *ptr, size_t size, size_t align) {
+  return trace_realloc(
+      allocator,
+      ptr,
+      allocator_realloc_aligned(allocator, ptr, size, align),
+      size,
+      align);
+}
+
+void fstd_free(fstd_allocator_t *allocator, void *ptr) {
+  trace_free(allocator, ptr);
+  allocator_free(allocator, ptr);
+}
+
+// Splits a free header that is not in any bin into up to `count` used
+// headers of `size` bytes, binning what's left. Returns how many it made.
+static inline size_t header_carve(
+    fstd_allocator_t *allocator,
+    fstd_alloc_header_t *header,
+    size_t size,
+    size_t count,
+    void **ptrs) {
+  size_t total_size = header_size(header);
+  size_t carved = total_size / size;
+  if (carved > count) {
+    carved = count;
+  }
+  assert(carved > 0);
+
+  // Free headers always follow used ones
+  uint8_t *start = (uint8_t *)header;
+  uint32_t first_flag = header->size & FSTD__HEADER_FIRST;
+  for (size_t i = 0; i < carved; i++) {
+    fstd_alloc_header_t *new_header =
+        (fstd_alloc_header_t *)(start + i * size);
+    new_header->size =
+        (uint32_t)size | FSTD__HEADER_USED | FSTD__HEADER_PREV_USED;
+    ptrs[i] = FSTD__HEADER_ADDR(new_header);
+  }
+  header->size |= first_flag;
+
+  fstd_alloc_header_t *last =
+      (fstd_alloc_header_t *)(start + (carved - 1) * size);
+  size_t rest = total_size - carved * size;
+  if (rest < FSTD__ALLOC_MIN_SIZE) {
+    last->size += (uint32_t)rest;
+    header_next(last)->size |= FSTD__HEADER_PREV_USED;
+  } else {
+    // The header after this one is used, as free ones are always merged
+    fstd_alloc_header_t *rest_header = header_next(last);
+    rest_header->size = FSTD__HEADER_PREV_USED;
+    header_set_free(rest_header, rest);
+    bin_insert(allocator, rest_header);
+    allocator->rover = rest_header;
+  }
+
+  return carved;
+}
+
+static size_t allocator_alloc_batch(
+    fstd_allocator_t *allocator, size_t size, size_t count, void **ptrs) {
+  if (size > allocator->large_threshold ||
+      (allocator->slab_max_size != 0 && size <= allocator->slab_max_size)) {
+    for (size_t i = 0; i < count; i++) {
+      ptrs[i] = allocator_alloc(allocator, size);
+      if (ptrs[i] == NULL) {
+        return i;
+      }
+    }
+    return count;
+  }
+
+  size = fstd__alloc_chunk_size(size);
+  size_t max_size = allocator->max_block_size - FSTD_ALLOC_BLOCK_OVERHEAD;
+
+  size_t done = 0;
+  while (done < count) {
+    // Ideally one header fits everything that's left
+    size_t wanted_size = max_size / size < count - done
+                             ? max_size / size * size
+                             : (count - done) * size;
+
+    fstd_alloc_header_t *header = bin_find(allocator, wanted_size);
+    if (header == NULL) {
+      header = bin_find(allocator, size);
+    }
+    if (header == NULL) {
+      header = block_add(allocator, wanted_size);
+      if (header == NULL) {
+        return done;
+      }
+    }
+
+    size_t carved =
+        header_carve(allocator, header, size, count - done, ptrs + done);
+    for (size_t i = 0; i < carved; i++) {
+      FSTD__ALLOC_COUNT(allocator, allocs);
+      stats_add_live(allocator, ptrs[done + i]);
+    }
+    done += carved;
+  }
+
+  return done;
+}
+
+// Free headers from fstd_free_batch that aren't merged yet point to
+// themselves, which no binned header does
+#define FSTD__HEADER_IS_UNMERGED(header)                                       \
+  (FSTD__HEADER_LINKS(header)->next_free == (header))
+
+size_t fstd_alloc_batch(
+    fstd_allocator_t *allocator, size_t size, size_t count, void **ptrs) {
+  size_t done = allocator_alloc_batch(allocator, size, count, ptrs);
+  for (size_t i = 0; i < done; i++) {
+    trace_alloc(allocator, ptrs[i], size, FSTD__ALLOC_ALIGNMENT);
+  }
+  return done;
+}
+
+void fstd_free_batch(fstd_allocator_t *allocator, void **ptrs, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    trace_free(allocator, ptrs[i]);
+  }
+
+  size_t freed = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    if (slab_find(allocator, ptrs[i]) != NULL) {
+      continue;
+    }
+
+    fstd_alloc_header_t *header =
+        (fstd_alloc_header_t *)(((uint8_t *)ptrs[i]) -
+                                sizeof(fstd_alloc_header_t));
+    assert(header_used(header));
+
+    if (header->size & FSTD__HEADER_LARGE) {
+      continue;
+    }
+
+    FSTD__ALLOC_COUNT(allocator, frees);
+    stats_remove_live(allocator, ptrs[i]);
+
+    header_set_free(header, header_size(header));
+    FSTD__HEADER_LINKS(header)->next_free = header;
+    freed++;
+  }
+
+  // Counted first, so the blocks this empties start from the batch's end
+  size_t free_count = allocator->free_count;
+  allocator->free_count += freed;
+
+  for (size_t i = 0; i < count; i++) {
+    fstd_alloc_slab_t *slab = slab_find(allocator, ptrs[i]);
+    if (slab != NULL) {
+      FSTD__ALLOC_COUNT(allocator, frees);
+      slab_free(allocator, slab, ptrs[i]);
+      continue;
+    }
+
+    fstd_alloc_header_t *header =
+        (fstd_alloc_header_t *)(((uint8_t *)ptrs[i]) -
+                                sizeof(fstd_alloc_header_t));
+    if (header->size & FSTD__HEADER_LARGE) {
+      allocator_free(allocator, ptrs[i]);
+      continue;
+    }
+    if (!FSTD__HEADER_IS_UNMERGED(header)) {
+      // Already merged into a header before it
+      continue;
+    }
+
+    // Merge the whole run of free headers this one is in, taking the ones
+    // freed before this batch out of their bins
+    while (!(header->size & FSTD__HEADER_PREV_USED)) {
+      header = header_prev(header);
+    }
+
+    size_t size = 0;
+    fstd_alloc_header_t *run_header = header;
+    while (!header_used(run_header)) {
+      if (FSTD__HEADER_IS_UNMERGED(run_header)) {
+        FSTD__HEADER_LINKS(run_header)->next_free = NULL;
+      } else {
+        bin_remove(allocator, run_header);
+      }
+      size += header_size(run_header);
+      run_header = header_next(run_header);
+    }
+
+    header_set_free(header, size);
+    bin_insert(allocator, header);
+    allocator->rover = header;
+  }
+
+  if (allocator->decommit_after_frees != 0 &&
+      free_count / allocator->decommit_after_frees !=
+          allocator->free_count / allocator->decommit_after_frees) {
+    decommit_sweep(allocator);
+  }
+}
+
+size_t fstd_allocator_trim(fstd_allocator_t *allocator, size_t keep_bytes) {
+  size_t kept_bytes = 0;
+  size_t released_bytes = 0;
+
+  for (size_t i = 0; i < FSTD__ALLOC_SLAB_CLASS_COUNT; i++) {
+    fstd_alloc_slab_t *slab = allocator->slabs[i];
+    while (slab != NULL) {
+      fstd_alloc_slab_t *next = slab->next;
+      if (slab->used_count == 0) {
+        if (kept_bytes + FSTD_ALLOC_SLAB_SIZE <= keep_bytes) {
+          kept_bytes += FSTD_ALLOC_SLAB_SIZE;
+        } else {
+          slab_destroy(allocator, slab);
+          released_bytes += FSTD_ALLOC_SLAB_SIZE;
+        }
+      }
+      slab = next;
+    }
+  }
+
+  fstd_alloc_block_t *block = allocator->last_block;
+  while (block != &allocator->base_block) {
+    fstd_alloc_block_t *prev = block->prev;
+    fstd_alloc_header_t *header = block->first_header;
+
+    if (!header_used(header) && header_is_block(header)) {
+      if (kept_bytes + block->size <= keep_bytes) {
+        kept_bytes += block->size;
+      } else {
+        bin_remove(allocator, header);
+
+        prev->next = block->next;
+        if (block->next != NULL) {
+          block->next->prev = prev;
+        } else {
+          allocator->last_block = prev;
+        }
+
+        released_bytes += block->size;
+        block_free_storage(block);
+        free(block);
+      }
+    }
+
+    block = prev;
+  }
+
+  // Not stamped when it's been decommitted, or not used, since it was last
+  // empty
+  fstd_alloc_header_t *header = allocator->base_block.first_header;
+  if (!header_used(header) && header_is_block(header) &&
+      FSTD__HEADER_EMPTY_BLOCK(header)->empty_since != SIZE_MAX &&
+      kept_bytes + allocator->base_block.size > keep_bytes) {
+    released_bytes += block_decommit(allocator, header);
+  }
+
+  return released_bytes;
+}
+
+void fstd_allocator_stats(
+    fstd_allocator_t *allocator, fstd_allocator_stats_t *stats) {
+  memset(stats, 0, sizeof(*stats));
+
+  fstd_alloc_block_t *block = &allocator->base_block;
+  while (block != NULL) {
+    stats->block_count++;
+    stats->block_bytes += block->size;
+    stats->overhead_bytes += FSTD_ALLOC_BLOCK_OVERHEAD;
+
+    fstd_alloc_header_t *header = block->first_header;
+    while (header != NULL) {
+      size_t size = header_size(header);
+      size_t payload_size = size - sizeof(fstd_alloc_header_t);
+
+      if (header_used(header)) {
+        stats->live_count++;
+        stats->live_bytes += payload_size;
+        stats->overhead_bytes += sizeof(fstd_alloc_header_t);
+        stats->live_histogram[fstd__alloc_fls(payload_size)]++;
+      } else {
+        stats->free_count++;
+        stats->free_bytes += size;
+        stats->free_histogram[fstd__alloc_fls(size)]++;
+        if (payload_size > stats->largest_free) {
+          stats->largest_free = payload_size;
+        }
+      }
+
+      header = fstd_alloc_header_next(header);
+    }
+
+    block = block->next;
+  }
+
+  fstd_alloc_large_t *large = allocator->large_list;
+  while (large != NULL) {
+    size_t payload_size = large_payload_size(large);
+    stats->large_count++;
+    stats->large_bytes += large->mapping_size;
+    stats->live_count++;
+    stats->live_bytes += payload_size;
+    stats->live_histogram[fstd__alloc_fls(payload_size)]++;
+    large = large->next;
+  }
+
+  for (size_t i = 0; i < allocator->slab_table_capacity; i++) {
+    fstd_alloc_slab_t *slab = allocator->slab_table[i];
+    if (slab == NULL) {
+      continue;
+    }
+    stats->slab_count++;
+    stats->slab_bytes += FSTD_ALLOC_SLAB_SIZE;
+    stats->live_count += slab->used_count;
+    stats->live_bytes += (size_t)slab->used_count * slab->slot_size;
+    stats->live_histogram[fstd__alloc_fls(slab->slot_size)] +=
+        slab->used_count;
+  }
+
+#ifdef FSTD_ALLOC_STATS
+  stats->counters = allocator->counters;
+#endif
+}
+
+#ifdef FSTD_ALLOC_TRACE
+void fstd_allocator_trace(fstd_allocator_t *allocator, FILE *file) {
+  if (file != NULL && ftell(file) <= 0) {
+    fwrite(FSTD_ALLOC_TRACE_MAGIC, 1, FSTD_ALLOC_TRACE_MAGIC_SIZE, file);
+  }
+
+  allocator->trace_file = file;
+  allocator->trace_time = fstd__alloc_now_ns();
+}
+#endif
+
+// Pushes `ptr` onto a lock-free stack, linking it through its first bytes.
+// Any number of threads can push at the same time.
+static inline void fstd__alloc_atomic_push(void **head, void *ptr) {
+#if defined(_MSC_VER)
+  void *old_head = *(void *volatile *)head;
+  for (;;) {
+    *(void **)ptr = old_head;
+    void *seen = InterlockedCompareExchangePointer(head, ptr, old_head);
+    if (seen == old_head) {
+      break;
+    }
+    old_head = seen;
+  }
+#else
+  void *old_head = __atomic_load_n(head, __ATOMIC_RELAXED);
+  do {
+    *(void **)ptr = old_head;
+  } while (!__atomic_compare_exchange_n(
+      head, &old_head, ptr, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+}
+
+// Takes the whole stack. Only one thread can do this, which is what keeps
+// the stack free of ABA problems.
+static inline void *fstd__alloc_atomic_take(void **head) {
+#if defined(_MSC_VER)
+  return InterlockedExchangePointer(head, NULL);
+#else
+  return __atomic_exchange_n(head, NULL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline bool fstd__alloc_atomic_is_empty(void **head) {
+#if defined(_MSC_VER)
+  return *(void *volatile *)head == NULL;
+#else
+  return __atomic_load_n(head, __ATOMIC_RELAXED) == NULL;
+#endif
+}
+
+// Allocator that owns `ptr`, which comes from a heap. Heaps don't use slabs,
+// so it's either in a mapping or in a block aligned to its size.
+static inline fstd_allocator_t *heap_owner(void *ptr) {
+  fstd_alloc_header_t *header =
+      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
+  if (header->size & FSTD__HEADER_LARGE) {
+    return large_from_header(header)->owner;
+  }
+
+  uintptr_t storage =
+      (uintptr_t)ptr & ~(uintptr_t)(FSTD_ALLOC_HEAP_BLOCK_SIZE - 1);
+  return *(fstd_allocator_t **)storage;
+}
+
+void fstd_heap_init(fstd_heap_t *heap) {
+  fstd_allocator_options_t options = {0};
+  fstd_heap_init_with_options(heap, &options);
+}
+
+void fstd_heap_init_with_options(
+    fstd_heap_t *heap, const fstd_allocator_options_t *options) {
+  fstd_allocator_options_t heap_options = *options;
+  heap_options.block_size = FSTD_ALLOC_HEAP_BLOCK_SIZE;
+  heap_options.aligned_blocks = true;
+  // heap_owner finds a pointer's block by masking it, which slabs would break
+  heap_options.slab_max_size = 0;
+
+  fstd_allocator_init_with_options(&heap->allocator, &heap_options);
+  assert(heap->allocator.block_size == FSTD_ALLOC_HEAP_BLOCK_SIZE);
+
+  heap->remote_frees = NULL;
+}
+
+void fstd_heap_destroy(fstd_heap_t *heap) {
+  fstd_heap_collect(heap);
+  fstd_allocator_destroy(&heap->allocator);
+}
+
+void *fstd_heap_alloc(fstd_heap_t *heap, size_t size) {
+  if (!fstd__alloc_atomic_is_empty(&heap->remote_frees)) {
+    fstd_heap_collect(heap);
+  }
+
+  return fstd_alloc(&heap->allocator, size);
+}
+
+void *fstd_heap_realloc(fstd_heap_t *heap, void *ptr, size_t size) {
+  if (ptr == NULL || heap_owner(ptr) == &heap->allocator) {
+    return fstd_realloc(&heap->allocator, ptr, size);
+  }
+
+  // Somebody else's memory moves into this heap
+  fstd_alloc_header_t *header =
+      (fstd_alloc_header_t *)(((uint8_t *)ptr) - sizeof(fstd_alloc_header_t));
+  size_t old_size = header_payload_size(header);
+
+  void *new_ptr = fstd_heap_alloc(heap, size);
+  if (new_ptr == NULL) {
+    return NULL;
+  }
+
+  memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+  fstd_heap_free(heap, ptr);
+
+  return new_ptr;
+}
+
+void fstd_heap_free(fstd_heap_t *heap, void *ptr) {
+  fstd_allocator_t *owner = heap_owner(ptr);
+  if (owner == &heap->allocator) {
+    fstd_free(&heap->allocator, ptr);
+    return;
+  }
+
+  // The allocator is the first member of its heap
+  fstd__alloc_atomic_push(&((fstd_heap_t *)owner)->remote_frees, ptr);
+}
+
+void fstd_heap_collect(fstd_heap_t *heap) {
+  void *ptr = fstd__alloc_atomic_take(&heap->remote_frees);
+  while (ptr != NULL) {
+    void *next = *(void **)ptr;
+    fstd_free(&heap->allocator, ptr);
+    ptr = next;
+  }
+}
+
+void fstd_arena_init(fstd_arena_t *arena, size_t block_size) {
+  arena->block_size = block_size;
+  arena->offset = 0;
+
+  block_init_storage(
+      &arena->base_block, block_size, FSTD_ALLOC_STORAGE_MALLOC, 0);
+
+  arena->current_block = &arena->base_block;
+}
+
+void fstd_arena_destroy(fstd_arena_t *arena) {
+  block_destroy(&arena->base_block);
+}
+
+// Links a new block with room for `size` bytes right after the current one,
+// ahead of any left over by a rollback or reset. Returns NULL when out of
+// memory.
+static fstd_alloc_block_t *arena_block_add(fstd_arena_t *arena, size_t size) {
+  fstd_alloc_block_t *block =
+      (fstd_alloc_block_t *)malloc(sizeof(fstd_alloc_block_t));
+  if (block == NULL) {
+    return NULL;
+  }
+  block_init_storage(
+      block,
+      size > arena->block_size ? size : arena->block_size,
+      FSTD_ALLOC_STORAGE_MALLOC,
+      0);
+  if (block->storage == NULL) {
+    free(block);
+    return NULL;
+  }
+
+  fstd_alloc_block_t *current = arena->current_block;
+  block->prev = current;
+  block->next = current->next;
+  if (current->next != NULL) {
+    current->next->prev = block;
+  }
+  current->next = block;
+  return block;
+}
+
+void *fstd_arena_alloc(fstd_arena_t *arena, size_t size) {
+  size_t offset = (arena->offset + FSTD__ALLOC_ALIGNMENT - 1) &
+                  ~(size_t)(FSTD__ALLOC_ALIGNMENT - 1);
+  size_t block_size = arena->current_block->size;
+
+  if (size > block_size || offset > block_size - size) {
+    // Move on to the next block, reusing one left over by a rollback or reset
+    // unless the allocation is too big for it
+    fstd_alloc_block_t *block = arena->current_block->next;
+    if (block == NULL || size > block->size) {
+      block = arena_block_add(arena, size);
+      if (block == NULL) {
+        return NULL;
+      }
+    }
+
+    arena->current_block->arena_offset = arena->offset;
+    arena->current_block = block;
+    offset = 0;
+  }
+
+  arena->offset = offset + size;
+
+  return arena->current_block->storage + offset;
+}
+
+fstd_arena_mark_t fstd_arena_mark(fstd_arena_t *arena) {
+  fstd_arena_mark_t mark;
+  mark.block = arena->current_block;
+  mark.offset = arena->offset;
+  return mark;
+}
+
+void fstd_arena_rollback(fstd_arena_t *arena, fstd_arena_mark_t mark) {
+  arena->current_block = mark.block;
+  arena->offset = mark.offset;
+}
+
+void fstd_arena_reset(fstd_arena_t *arena) {
+  arena->current_block = &arena->base_block;
+  arena->offset = 0;
+}
+
+void fstd_stack_allocator_init(
+    fstd_stack_allocator_t *stack, size_t block_size) {
+  fstd_arena_init(&stack->arena, block_size);
+  stack->frame = NULL;
+}
+
+void fstd_stack_allocator_destroy(fstd_stack_allocator_t *stack) {
+  fstd_arena_destroy(&stack->arena);
+}
+
+void *fstd_stack_alloc(fstd_stack_allocator_t *stack, size_t size) {
+  return fstd_arena_alloc(&stack->arena, size);
+}
+
+static inline bool block_contains(fstd_alloc_block_t *block, void *ptr) {
+  return (uint8_t *)ptr >= block->storage &&
+         (uint8_t *)ptr < block->storage + block->size;
+}
+
+// Whether `ptr`, in `block`, was allocated after the innermost frame
+static inline bool stack_above_frame(
+    fstd_stack_allocator_t *stack, fstd_alloc_block_t *block, void *ptr) {
+  return stack->frame == NULL ||
+         !block_contains(block, stack->frame) ||
+         (uint8_t *)ptr > (uint8_t *)stack->frame;
+}
+
+void fstd_stack_free(fstd_stack_allocator_t *stack, void *ptr) {
+  fstd_arena_t *arena = &stack->arena;
+  fstd_alloc_block_t *block = arena->current_block;
+
+  // Once the current block is empty, the top is back in the previous one
+  if (!block_contains(block, ptr)) {
+    assert(arena->offset == 0 && block->prev != NULL);
+    block = block->prev;
+    arena->current_block = block;
+  }
+
+  assert(block_contains(block, ptr));
+  assert(stack_above_frame(stack, block, ptr));
+  arena->offset = (size_t)((uint8_t *)ptr - block->storage);
+}
+
+bool fstd_stack_push_frame(fstd_stack_allocator_t *stack) {
+  fstd_arena_mark_t mark = fstd_arena_mark(&stack->arena);
+
+  fstd__stack_frame_t *frame =
+      fstd_arena_alloc(&stack->arena, sizeof(fstd__stack_frame_t));
+  if (frame == NULL) {
+    return false;
+  }
+  frame->prev = stack->frame;
+  frame->mark = mark;
+  stack->frame = frame;
+  return true;
+}
+
+void fstd_stack_pop_frame(fstd_stack_allocator_t *stack) {
+  fstd__stack_frame_t *frame = stack->frame;
+  assert(frame != NULL);
+
+  stack->frame = frame->prev;
+  fstd_arena_rollback(&stack->arena, frame->mark);
+}
+
+static void *interface_libc_alloc(void *ctx, size_t size) {
+  (void)ctx;
+  return malloc(size);
+}
+
+static void *interface_libc_realloc(
+    void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  (void)ctx;
+  (void)old_size;
+  return realloc(ptr, new_size);
+}
+
+static void interface_libc_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+fstd_alloc_interface_t fstd_alloc_interface_libc(void) {
+  fstd_alloc_interface_t interface;
+  interface.alloc = interface_libc_alloc;
+  interface.realloc = interface_libc_realloc;
+  interface.free = interface_libc_free;
+  interface.ctx = NULL;
+  return interface;
+}
+
+static void *interface_allocator_alloc(void *ctx, size_t size) {
+  return fstd_alloc((fstd_allocator_t *)ctx, size);
+}
+
+static void *interface_allocator_realloc(
+    void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  (void)old_size;
+  return fstd_realloc((fstd_allocator_t *)ctx, ptr, new_size);
+}
+
+static void interface_allocator_free(void *ctx, void *ptr, size_t size) {
+  (void)size;
+  fstd_free((fstd_allocator_t *)ctx, ptr);
+}
+
+fstd_alloc_interface_t
+fstd_alloc_interface_allocator(fstd_allocator_t *allocator) {
+  fstd_alloc_interface_t interface;
+  interface.alloc = interface_allocator_alloc;
+  interface.realloc = interface_allocator_realloc;
+  interface.free = interface_allocator_free;
+  interface.ctx = allocator;
+  return interface;
+}
+
+static void *interface_heap_alloc(void *ctx, size_t size) {
+  return fstd_heap_alloc((fstd_heap_t *)ctx, size);
+}
+
+static void *interface_heap_realloc(
+    void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  (void)old_size;
+  return fstd_heap_realloc((fstd_heap_t *)ctx, ptr, new_size);
+}
+
+static void interface_heap_free(void *ctx, void *ptr, size_t size) {
+  (void)size;
+  fstd_heap_free((fstd_heap_t *)ctx, ptr);
+}
+
+fstd_alloc_interface_t fstd_alloc_interface_heap(fstd_heap_t *heap) {
+  fstd_alloc_interface_t interface;
+  interface.alloc = interface_heap_alloc;
+  interface.realloc = interface_heap_realloc;
+  interface.free = interface_heap_free;
+  interface.ctx = heap;
+  return interface;
+}
+
+static void *interface_arena_alloc(void *ctx, size_t size) {
+  return fstd_arena_alloc((fstd_arena_t *)ctx, size);
+}
+
+static void *interface_arena_realloc(
+    void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  fstd_arena_t *arena = (fstd_arena_t *)ctx;
+  if (ptr == NULL) {
+    return fstd_arena_alloc(arena, new_size);
+  }
+
+  // The latest allocation can be resized by moving the offset
+  uint8_t *storage = arena->current_block->storage;
+  if ((uint8_t *)ptr + old_size == storage + arena->offset &&
+      new_size <= arena->current_block->size - ((uint8_t *)ptr - storage)) {
+    arena->offset = (size_t)((uint8_t *)ptr - storage) + new_size;
+    return ptr;
+  }
+
+  if (new_size <= old_size) {
+    return ptr;
+  }
+
+  void *new_ptr = fstd_arena_alloc(arena, new_size);
+  if (new_ptr != NULL) {
+    memcpy(new_ptr, ptr, old_size);
+  }
+  return new_ptr;
+}
+
+static void interface_arena_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)ptr;
+  (void)size;
+}
+
+fstd_alloc_interface_t fstd_alloc_interface_arena(fstd_arena_t *arena) {
+  fstd_alloc_interface_t interface;
+  interface.alloc = interface_arena_alloc;
+  interface.realloc = interface_arena_realloc;
+  interface.free = interface_arena_free;
+  interface.ctx = arena;
+  return interface;
+}
+
+static void *interface_stack_alloc(void *ctx, size_t size) {
+  return fstd_stack_alloc((fstd_stack_allocator_t *)ctx, size);
+}
+
+static void *interface_stack_realloc(
+    void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  return interface_arena_realloc(
+      &((fstd_stack_allocator_t *)ctx)->arena, ptr, old_size, new_size);
+}
+
+static void interface_stack_free(void *ctx, void *ptr, size_t size) {
+  fstd_stack_allocator_t *stack = (fstd_stack_allocator_t *)ctx;
+  fstd_alloc_block_t *block = stack->arena.current_block;
+  size_t top = stack->arena.offset;
+  if (!block_contains(block, ptr) && top == 0 &&
+      block->prev != NULL) {
+    block = block->prev;
+    top = block->arena_offset;
+  }
+
+  if (!block_contains(block, ptr) ||
+      !stack_above_frame(stack, block, ptr)) {
+    return;
+  }
+
+  // The allocation is the topmost one when the top is its end, or its end
+  // rounded up to the alignment once the ones after it were given back
+  size_t start = (size_t)((uint8_t *)ptr - block->storage);
+  size_t end = start + size;
+  size_t aligned_end = (end + FSTD__ALLOC_ALIGNMENT - 1) &
+                       ~(size_t)(FSTD__ALLOC_ALIGNMENT - 1);
+  if (top >= end && top <= aligned_end) {
+    fstd_stack_free(stack, ptr);
+  }
+}
+
+fstd_alloc_interface_t
+fstd_alloc_interface_stack(fstd_stack_allocator_t *stack) {
+  fstd_alloc_interface_t interface;
+  interface.alloc = interface_stack_alloc;
+  interface.realloc = interface_stack_realloc;
+  interface.free = interface_stack_free;
+  interface.ctx = stack;
+  return interface;
 }
 
 #endif // FSTD_ALLOC_IMPLEMENTATION
@@ -7,6 +7,11 @@ extern "C" {
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #define FSTD_BITSET(size)                                                      \
   struct {                                                                     \
@@ -32,11 +37,72 @@ static inline void fstd_bitset_set(void *bitset, uint32_t pos, bool val) {
 // Sets the bitset to zero
 static inline void fstd_bitset_reset(void *bitset, uint32_t size) {
   unsigned char *bytes = (unsigned char *)bitset;
-  for (uint32_t i = 0; i < size / 8; i++) {
+  for (uint32_t i = 0; i < (size + 7) / 8; i++) {
     bytes[i] = 0UL;
   }
 }
 
+static inline uint32_t fstd__bitset_ctz(uint64_t x) {
+#if defined(_MSC_VER) && defined(_WIN64)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (uint32_t)index;
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanForward(&index, (unsigned long)x)) {
+    return (uint32_t)index;
+  }
+  _BitScanForward(&index, (unsigned long)(x >> 32));
+  return (uint32_t)index + 32;
+#else
+  return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+// Bits `pos` to `pos + 63` as a word, bit 0 being `pos`. `pos` is a multiple
+// of 8, and bytes past `size` bits read as set.
+static inline uint64_t
+fstd__bitset_word(const unsigned char *bytes, uint32_t pos, uint32_t size) {
+  uint32_t byte_count = (size + 7) / 8 - pos / 8;
+  if (byte_count >= 8) {
+    uint64_t word;
+    memcpy(&word, bytes + pos / 8, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+  }
+
+  uint64_t word = ~(uint64_t)0;
+  for (uint32_t i = 0; i < byte_count; i++) {
+    word &= ~((uint64_t)0xFF << (i * 8));
+    word |= (uint64_t)bytes[pos / 8 + i] << (i * 8);
+  }
+  return word;
+}
+
+// Position of the first zero bit at or after `start`, looking at 64 bits at
+// a time, or `size` when there is none
+static inline uint32_t
+fstd_bitset_find_zero(const void *bitset, uint32_t start, uint32_t size) {
+  const unsigned char *bytes = (const unsigned char *)bitset;
+
+  uint32_t pos = start & ~(uint32_t)7;
+  // Bits before `start` count as set
+  uint64_t skipped = ((uint64_t)1 << (start - pos)) - 1;
+  while (pos < size) {
+    uint64_t word = fstd__bitset_word(bytes, pos, size) | skipped;
+    if (word != ~(uint64_t)0) {
+      uint32_t found = pos + fstd__bitset_ctz(~word);
+      return found < size ? found : size;
+    }
+    pos += 64;
+    skipped = 0;
+  }
+
+  return size;
+}
+
 #ifdef __cplusplus
 }
 #endif
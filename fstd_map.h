@@ -5,6 +5,8 @@
 extern "C" {
 #endif
 
+#include "fstd_alloc.h"
+#include "fstd_bitset.h"
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,18 +17,60 @@ typedef enum fstd__map_value_state_t {
   FSTD__MAP_VALUE_FILLED,
 } fstd__map_value_state_t;
 
+// Hashes a key. `seed` changes which keys collide, so that they can't be
+// picked to all land in the same bundles.
+typedef uint64_t (*fstd_map_hash_fn_t)(const char *key, uint64_t seed);
+
+// Growing and shrinking rehash everything into a new array of bundles, so
+// values move: pointers returned by fstd_map_get and fstd_map_set are only
+// valid until the next fstd_map_set (or any call, see rehash_step).
 typedef struct fstd_map_t {
   void *bundles;
   size_t capacity;
   size_t filled;
+  size_t deleted; // Bundles left behind by fstd_map_remove
+  // The map grows once more than this fraction of its bundles are filled or
+  // deleted (or just rehashes, if most of them were deleted). 1 keeps the
+  // capacity fixed, so fstd_map_set fails once every bundle is filled.
+  float max_load;
+  // The map shrinks by halves while less than this fraction of its bundles
+  // are filled, down to the capacity it was created with (at least 1). 0
+  // means never.
+  float min_load;
+  size_t min_capacity;
+  // When not 0, resizing only allocates the new bundles. Every
+  // fstd_map_get, fstd_map_set and fstd_map_remove then clears
+  // FSTD_MAP_CLEAR_STEP times this many of them, and once they're all clear,
+  // moves this many of the old ones over, looking in both arrays until all
+  // of them are. This bounds the time any call takes, but values can then
+  // move on any call.
+  size_t rehash_step;
+  void *next_bundles; // Bundles being cleared, or NULL
+  size_t next_capacity;
+  size_t next_cleared;
+  void *old_bundles; // Bundles being moved into `bundles`, or NULL
+  size_t old_capacity;
+  size_t rehash_index; // Next bundle of old_bundles to move
+  // Set by fstd_map_init_grouped: a control byte per bundle, holding 7 bits
+  // of its key's hash, lets lookups check a group of bundles at once with
+  // SSE2 or AVX2. The capacity is then a power of two.
+  bool grouped;
   size_t value_size;
   size_t value_offset;
   size_t bundle_size;
+  // fstd_map_wyhash by default, with a seed drawn for each map from the time
+  // and the address space layout. Set them right after initializing the map,
+  // e.g. to a seed from the OS's random source.
+  fstd_map_hash_fn_t hash_fn;
+  uint64_t seed;
+  // Where the bundles and the copies of the keys are allocated
+  fstd_alloc_interface_t allocator;
 } fstd_map_t;
 
 #define FSTD__BUNDLE(val_type)                                                 \
   struct {                                                                     \
     char *key;                                                                 \
+    size_t hash; /* Hash of key, so it's never computed again */               \
     fstd__map_value_state_t state;                                             \
     val_type val;                                                              \
   }
@@ -37,14 +81,52 @@ typedef struct fstd_map_t {
       capacity,                                                                \
       sizeof(val_type),                                                        \
       offsetof(FSTD__BUNDLE(val_type), val),                                   \
-      sizeof(FSTD__BUNDLE(val_type)))
+      sizeof(FSTD__BUNDLE(val_type)),                                          \
+      fstd_alloc_interface_libc(),                                             \
+      false)
+
+// Takes all of the map's memory from `allocator`. With an arena, the map can
+// be thrown away along with the arena without calling fstd_map_destroy. If
+// the bundles can't be allocated, the map starts with a capacity of 0.
+#define fstd_map_init_with_allocator(map, capacity, val_type, allocator)       \
+  fstd__map_init(                                                              \
+      map,                                                                     \
+      capacity,                                                                \
+      sizeof(val_type),                                                        \
+      offsetof(FSTD__BUNDLE(val_type), val),                                   \
+      sizeof(FSTD__BUNDLE(val_type)),                                          \
+      allocator,                                                               \
+      false)
+
+#define fstd_map_init_grouped(map, capacity, val_type)                         \
+  fstd__map_init(                                                              \
+      map,                                                                     \
+      capacity,                                                                \
+      sizeof(val_type),                                                        \
+      offsetof(FSTD__BUNDLE(val_type), val),                                   \
+      sizeof(FSTD__BUNDLE(val_type)),                                          \
+      fstd_alloc_interface_libc(),                                             \
+      true)
+
+#define fstd_map_init_grouped_with_allocator(                                  \
+    map, capacity, val_type, allocator)                                        \
+  fstd__map_init(                                                              \
+      map,                                                                     \
+      capacity,                                                                \
+      sizeof(val_type),                                                        \
+      offsetof(FSTD__BUNDLE(val_type), val),                                   \
+      sizeof(FSTD__BUNDLE(val_type)),                                          \
+      allocator,                                                               \
+      true)
 
 void fstd__map_init(
     fstd_map_t *map,
     size_t capacity,
     size_t value_size,
     size_t value_offset,
-    size_t bundle_size);
+    size_t bundle_size,
+    fstd_alloc_interface_t allocator,
+    bool grouped);
 
 void *fstd_map_get(fstd_map_t *map, const char *key);
 
@@ -54,12 +136,21 @@ void *fstd_map_get_by_index(fstd_map_t *map, size_t index, char **key);
 
 char *fstd_map_get_key(fstd_map_t *map, void *value);
 
+// Returns NULL when the key can't be added, as memory ran out or max_load is
+// 1 and every bundle is filled.
 void *fstd_map_set(fstd_map_t *map, const char *key, void *value);
 
 void *fstd_map_remove(fstd_map_t *map, const char *key);
 
 void fstd_map_destroy(fstd_map_t *map);
 
+// wyhash (https://github.com/wangyi-fudan/wyhash), reading the key 8 bytes
+// at a time
+uint64_t fstd_map_wyhash(const char *key, uint64_t seed);
+
+// The map's original hash, a byte at a time. It ignores the seed.
+uint64_t fstd_map_djb_hash(const char *key, uint64_t seed);
+
 static inline size_t fstd__djb_hash(const char *str) {
   size_t hash = 5381;
   char c;
@@ -72,58 +163,608 @@ static inline size_t fstd__djb_hash(const char *str) {
 
 #ifdef FSTD_MAP_IMPLEMENTATION
 
+#ifndef FSTD_MAP_MAX_LOAD
+#define FSTD_MAP_MAX_LOAD 0.75f
+#endif
+
+#ifndef FSTD_MAP_CLEAR_STEP
+#define FSTD_MAP_CLEAR_STEP 16
+#endif
+
+#include <time.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FSTD__MAP_AVX2
+#define FSTD__MAP_GROUP_SIZE 32
+#elif defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FSTD__MAP_SSE2
+#define FSTD__MAP_GROUP_SIZE 16
+#else
+#define FSTD__MAP_GROUP_SIZE 16
+#endif
+
+// Control bytes of grouped maps. Filled bundles have the high bit set, with
+// the low 7 bits of the hash below it, and zeroed memory is all empty.
+#define FSTD__MAP_CTRL_EMPTY 0x00
+#define FSTD__MAP_CTRL_DELETED 0x01
+#define FSTD__MAP_CTRL_FILLED(hash) ((uint8_t)(0x80 | ((hash)&0x7F)))
+
 #define FSTD__MAP_BUNDLE(map, hash)                                            \
-  (&((char *)map->bundles)[hash * map->bundle_size])
+  (&((char *)(map)->bundles)[(hash) * (map)->bundle_size])
+
+#define FSTD__MAP_BUNDLE_KEY(map, hash) ((char **)FSTD__MAP_BUNDLE(map, hash))
 
-#define FSTD__MAP_BUNDLE_KEY(map, hash) ((char **)FSTD__MAP_BUNDLE(map, hash));
+#define FSTD__MAP_BUNDLE_HASH(map, hash)                                       \
+  ((size_t *)(FSTD__MAP_BUNDLE(map, hash) + sizeof(char *)))
 
 #define FSTD__MAP_BUNDLE_STATE(map, hash)                                      \
-  ((fstd__map_value_state_t *)(FSTD__MAP_BUNDLE(map, hash) + sizeof(char *)));
+  ((fstd__map_value_state_t *)(FSTD__MAP_BUNDLE(map, hash) + sizeof(char *) + \
+                               sizeof(size_t)))
 
 #define FSTD__MAP_BUNDLE_VALUE(map, hash)                                      \
-  (FSTD__MAP_BUNDLE(map, hash) + map->value_offset);
+  (FSTD__MAP_BUNDLE(map, hash) + (map)->value_offset)
+
+// The control bytes of a grouped map, right after its bundles
+#define FSTD__MAP_CTRL(map)                                                    \
+  ((uint8_t *)(map)->bundles + (map)->capacity * (map)->bundle_size)
+
+// Bit `i` is set if the group's control byte `i` is `byte`
+static inline uint32_t
+fstd__map_group_match(const uint8_t *ctrl, uint8_t byte) {
+#if defined(FSTD__MAP_AVX2)
+  __m256i group = _mm256_loadu_si256((const __m256i *)ctrl);
+  return (uint32_t)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(group, _mm256_set1_epi8((char)byte)));
+#elif defined(FSTD__MAP_SSE2)
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < FSTD__MAP_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(ctrl[i] == byte) << i;
+  }
+  return mask;
+#endif
+}
+
+// Bit `i` is set if the group's bundle `i` is empty or deleted
+static inline uint32_t fstd__map_group_match_free(const uint8_t *ctrl) {
+#if defined(FSTD__MAP_AVX2)
+  __m256i group = _mm256_loadu_si256((const __m256i *)ctrl);
+  return ~(uint32_t)_mm256_movemask_epi8(group);
+#elif defined(FSTD__MAP_SSE2)
+  __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+  return ~(uint32_t)_mm_movemask_epi8(group) & 0xFFFF;
+#else
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < FSTD__MAP_GROUP_SIZE; i++) {
+    mask |= (uint32_t)(ctrl[i] < 0x80) << i;
+  }
+  return mask;
+#endif
+}
+
+// Bytes taken by `capacity` bundles, and their control bytes
+static inline size_t fstd__map_bundles_size(fstd_map_t *map, size_t capacity) {
+  return capacity * (map->bundle_size + (map->grouped ? 1 : 0));
+}
+
+// Clears bundles `start` to `start + count` of an array of `capacity` of them
+static inline void fstd__map_clear(
+    fstd_map_t *map,
+    void *bundles,
+    size_t capacity,
+    size_t start,
+    size_t count) {
+  memset(
+      (char *)bundles + start * map->bundle_size, 0, count * map->bundle_size);
+  if (map->grouped) {
+    memset((char *)bundles + capacity * map->bundle_size + start, 0, count);
+  }
+}
+
+// Sets `a` and `b` to the low and high halves of their 128-bit product
+static inline void fstd__map_wymum(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+  __uint128_t product = (__uint128_t)*a * *b;
+  *a = (uint64_t)product;
+  *b = (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  *a = _umul128(*a, *b, b);
+#else
+  uint64_t a_high = *a >> 32, a_low = (uint32_t)*a;
+  uint64_t b_high = *b >> 32, b_low = (uint32_t)*b;
+  uint64_t high = a_high * b_high;
+  uint64_t middle0 = a_high * b_low;
+  uint64_t middle1 = b_high * a_low;
+  uint64_t low = a_low * b_low;
+  uint64_t t = low + (middle0 << 32);
+  uint64_t carry = t < low;
+  low = t + (middle1 << 32);
+  carry += low < t;
+  *a = low;
+  *b = high + (middle0 >> 32) + (middle1 >> 32) + carry;
+#endif
+}
+
+static inline uint64_t fstd__map_wymix(uint64_t a, uint64_t b) {
+  fstd__map_wymum(&a, &b);
+  return a ^ b;
+}
+
+static inline uint64_t fstd__map_read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint64_t fstd__map_read4(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+// Reads 1 to 3 bytes
+static inline uint64_t fstd__map_read3(const uint8_t *p, size_t length) {
+  return ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) |
+         p[length - 1];
+}
+
+uint64_t fstd_map_wyhash(const char *key, uint64_t seed) {
+  static const uint64_t secret[4] = {
+      0x2d358dccaa6c78a5ull,
+      0x8bb84b93962eacc9ull,
+      0x4b33a62ed433d4a3ull,
+      0x4d5a2da51de1aa47ull,
+  };
+
+  const uint8_t *p = (const uint8_t *)key;
+  size_t length = strlen(key);
+  seed ^= fstd__map_wymix(seed ^ secret[0], secret[1]);
+
+  uint64_t a, b;
+  if (length <= 16) {
+    if (length >= 4) {
+      size_t offset = (length >> 3) << 2;
+      a = (fstd__map_read4(p) << 32) | fstd__map_read4(p + offset);
+      b = (fstd__map_read4(p + length - 4) << 32) |
+          fstd__map_read4(p + length - 4 - offset);
+    } else if (length > 0) {
+      a = fstd__map_read3(p, length);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = length;
+    if (i > 48) {
+      // Three independent lanes
+      uint64_t seed1 = seed, seed2 = seed;
+      do {
+        seed = fstd__map_wymix(
+            fstd__map_read8(p) ^ secret[1], fstd__map_read8(p + 8) ^ seed);
+        seed1 = fstd__map_wymix(
+            fstd__map_read8(p + 16) ^ secret[2],
+            fstd__map_read8(p + 24) ^ seed1);
+        seed2 = fstd__map_wymix(
+            fstd__map_read8(p + 32) ^ secret[3],
+            fstd__map_read8(p + 40) ^ seed2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= seed1 ^ seed2;
+    }
+    while (i > 16) {
+      seed = fstd__map_wymix(
+          fstd__map_read8(p) ^ secret[1], fstd__map_read8(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // The last 16 bytes, overlapping what was already read
+    a = fstd__map_read8(p + i - 16);
+    b = fstd__map_read8(p + i - 8);
+  }
+
+  a ^= secret[1];
+  b ^= seed;
+  fstd__map_wymum(&a, &b);
+  return fstd__map_wymix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+uint64_t fstd_map_djb_hash(const char *key, uint64_t seed) {
+  (void)seed;
+  return fstd__djb_hash(key);
+}
+
+// Seed for a new map. Not cryptographically random, but it changes with the
+// time, the address space layout and from map to map.
+static uint64_t fstd__map_random_seed(fstd_map_t *map) {
+#if defined(_MSC_VER)
+  static volatile long counter;
+  uint64_t count = (uint64_t)_InterlockedIncrement(&counter);
+#else
+  static uint64_t counter;
+  uint64_t count = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+#endif
+
+  struct timespec ts = {0};
+  timespec_get(&ts, TIME_UTC);
+
+  uint64_t seed = fstd__map_wymix(
+      (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec,
+      (uint64_t)(uintptr_t)map ^ 0x8bb84b93962eacc9ull);
+  return fstd__map_wymix(
+      seed ^ (uint64_t)(uintptr_t)&counter, count ^ 0x4b33a62ed433d4a3ull);
+}
 
 void fstd__map_init(
     fstd_map_t *map,
     size_t capacity,
     size_t value_size,
     size_t value_offset,
-    size_t bundle_size) {
+    size_t bundle_size,
+    fstd_alloc_interface_t allocator,
+    bool grouped) {
+  if (grouped) {
+    // Groups are probed by masking, and never straddle the end
+    size_t rounded = FSTD__MAP_GROUP_SIZE;
+    while (rounded < capacity) {
+      rounded *= 2;
+    }
+    capacity = rounded;
+  }
+
   map->capacity = capacity;
   map->filled = 0;
+  map->deleted = 0;
+  map->max_load = FSTD_MAP_MAX_LOAD;
+  map->min_load = 0.0f;
+  map->min_capacity = capacity;
+  map->rehash_step = 0;
+  map->next_bundles = NULL;
+  map->next_capacity = 0;
+  map->next_cleared = 0;
+  map->old_bundles = NULL;
+  map->old_capacity = 0;
+  map->rehash_index = 0;
+  map->grouped = grouped;
   map->value_size = value_size;
   map->value_offset = value_offset;
   map->bundle_size = bundle_size;
+  map->hash_fn = fstd_map_wyhash;
+  map->seed = fstd__map_random_seed(map);
+  map->allocator = allocator;
+
+  map->bundles = allocator.alloc(
+      allocator.ctx, fstd__map_bundles_size(map, map->capacity));
+  if (map->bundles == NULL) {
+    // Out of memory, so it starts empty and allocates on the first set
+    map->capacity = 0;
+    return;
+  }
+  fstd__map_clear(map, map->bundles, map->capacity, 0, map->capacity);
+}
 
-  map->bundles = calloc(map->capacity, map->bundle_size);
+// The old bundles of an incremental rehash, viewed as a map
+static inline fstd_map_t fstd__map_old(fstd_map_t *map) {
+  fstd_map_t old_map = *map;
+  old_map.bundles = map->old_bundles;
+  old_map.capacity = map->old_capacity;
+  return old_map;
 }
 
-void *fstd_map_get(fstd_map_t *map, const char *key) {
-  size_t hash = fstd__djb_hash(key);
+// Index of the filled bundle holding `key`, or SIZE_MAX
+static size_t fstd__map_find(fstd_map_t *map, const char *key, size_t hash) {
+  if (map->capacity == 0) {
+    return SIZE_MAX;
+  }
+
+  if (map->grouped) {
+    uint8_t *ctrl = FSTD__MAP_CTRL(map);
+    uint8_t filled = FSTD__MAP_CTRL_FILLED(hash);
+    size_t group_mask = map->capacity / FSTD__MAP_GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & group_mask;
+
+    // Triangular steps visit every group once
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+      uint8_t *group_ctrl = ctrl + group * FSTD__MAP_GROUP_SIZE;
+
+      uint32_t matches = fstd__map_group_match(group_ctrl, filled);
+      while (matches != 0) {
+        size_t index =
+            group * FSTD__MAP_GROUP_SIZE + fstd__bitset_ctz(matches);
+        if (*FSTD__MAP_BUNDLE_HASH(map, index) == hash &&
+            strcmp(*FSTD__MAP_BUNDLE_KEY(map, index), key) == 0) {
+          return index;
+        }
+        matches &= matches - 1;
+      }
+
+      if (fstd__map_group_match(group_ctrl, FSTD__MAP_CTRL_EMPTY) != 0) {
+        // The key would have been put in this group or before
+        return SIZE_MAX;
+      }
+
+      group = (group + step) & group_mask;
+    }
+    return SIZE_MAX;
+  }
+
   size_t index = hash % map->capacity;
   size_t index_start = index;
 
-  char **bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-  fstd__map_value_state_t *bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-  char *bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
+  for (;;) {
+    fstd__map_value_state_t *bundle_state =
+        FSTD__MAP_BUNDLE_STATE(map, index);
+    if (*bundle_state == FSTD__MAP_VALUE_EMPTY) {
+      // The key would have been put here or before
+      return SIZE_MAX;
+    }
+
+    char **bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
+    // Only keys with the same hash are worth fetching to compare
+    if (*bundle_state == FSTD__MAP_VALUE_FILLED &&
+        *FSTD__MAP_BUNDLE_HASH(map, index) == hash &&
+        strcmp(*bundle_key, key) == 0) {
+      return index;
+    }
 
-  while (*bundle_state != FSTD__MAP_VALUE_FILLED ||
-         (*bundle_key != NULL && strcmp(*bundle_key, key) != 0)) {
     index = (index + 1) % map->capacity;
+    if (index == index_start) {
+      return SIZE_MAX;
+    }
+  }
+}
 
-    bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-    bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-    bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
+// Index of the first empty or deleted bundle a key hashing to `hash` can go
+// in, or SIZE_MAX if every bundle is filled
+static size_t fstd__map_find_slot(fstd_map_t *map, size_t hash) {
+  if (map->capacity == 0) {
+    return SIZE_MAX;
+  }
 
-    if (index == index_start) {
-      return NULL;
+  if (map->grouped) {
+    uint8_t *ctrl = FSTD__MAP_CTRL(map);
+    size_t group_mask = map->capacity / FSTD__MAP_GROUP_SIZE - 1;
+    size_t group = (hash >> 7) & group_mask;
+
+    for (size_t step = 1; step <= group_mask + 1; step++) {
+      uint32_t free_mask =
+          fstd__map_group_match_free(ctrl + group * FSTD__MAP_GROUP_SIZE);
+      if (free_mask != 0) {
+        return group * FSTD__MAP_GROUP_SIZE + fstd__bitset_ctz(free_mask);
+      }
+      group = (group + step) & group_mask;
     }
+    return SIZE_MAX;
   }
 
-  return bundle_value;
+  size_t index = hash % map->capacity;
+  size_t index_start = index;
+
+  do {
+    if (*FSTD__MAP_BUNDLE_STATE(map, index) != FSTD__MAP_VALUE_FILLED) {
+      return index;
+    }
+    index = (index + 1) % map->capacity;
+  } while (index != index_start);
+
+  return SIZE_MAX;
+}
+
+static inline void fstd__map_fill(fstd_map_t *map, size_t index, size_t hash) {
+  *FSTD__MAP_BUNDLE_HASH(map, index) = hash;
+  *FSTD__MAP_BUNDLE_STATE(map, index) = FSTD__MAP_VALUE_FILLED;
+  if (map->grouped) {
+    FSTD__MAP_CTRL(map)[index] = FSTD__MAP_CTRL_FILLED(hash);
+  }
+}
+
+// Takes the key out of a filled bundle. Returns false if the bundle could be
+// made empty instead of deleted.
+static inline bool fstd__map_erase(fstd_map_t *map, size_t index) {
+  *FSTD__MAP_BUNDLE_KEY(map, index) = NULL;
+
+  if (map->grouped) {
+    // Probes only go past full groups, and a group that still has an empty
+    // bundle has never been full
+    uint8_t *ctrl = FSTD__MAP_CTRL(map);
+    uint8_t *group_ctrl =
+        ctrl + index / FSTD__MAP_GROUP_SIZE * FSTD__MAP_GROUP_SIZE;
+    if (fstd__map_group_match(group_ctrl, FSTD__MAP_CTRL_EMPTY) != 0) {
+      ctrl[index] = FSTD__MAP_CTRL_EMPTY;
+      *FSTD__MAP_BUNDLE_STATE(map, index) = FSTD__MAP_VALUE_EMPTY;
+      return false;
+    }
+    ctrl[index] = FSTD__MAP_CTRL_DELETED;
+  }
+
+  *FSTD__MAP_BUNDLE_STATE(map, index) = FSTD__MAP_VALUE_DELETED;
+  return true;
+}
+
+// Moves filled bundle `index` of the old bundles into the new ones, where
+// the key can't be yet. Returns its new index.
+static size_t
+fstd__map_move(fstd_map_t *map, fstd_map_t *old_map, size_t index) {
+  size_t hash = *FSTD__MAP_BUNDLE_HASH(old_map, index);
+
+  size_t new_index = fstd__map_find_slot(map, hash);
+  if (*FSTD__MAP_BUNDLE_STATE(map, new_index) == FSTD__MAP_VALUE_DELETED) {
+    map->deleted--;
+  }
+
+  memcpy(
+      FSTD__MAP_BUNDLE(map, new_index),
+      FSTD__MAP_BUNDLE(old_map, index),
+      map->bundle_size);
+  fstd__map_fill(map, new_index, hash);
+
+  fstd__map_erase(old_map, index);
+  return new_index;
+}
+
+// Does `count` steps of a resize: clearing the new bundles, then moving the
+// old ones over and freeing them. SIZE_MAX finishes it.
+static void fstd__map_rehash(fstd_map_t *map, size_t count) {
+  if (map->next_bundles != NULL) {
+    size_t clear_count = map->next_capacity - map->next_cleared;
+    if (count < clear_count / FSTD_MAP_CLEAR_STEP) {
+      clear_count = count * FSTD_MAP_CLEAR_STEP;
+    }
+    fstd__map_clear(
+        map,
+        map->next_bundles,
+        map->next_capacity,
+        map->next_cleared,
+        clear_count);
+    map->next_cleared += clear_count;
+
+    if (map->next_cleared < map->next_capacity) {
+      return;
+    }
+
+    map->old_bundles = map->bundles;
+    map->old_capacity = map->capacity;
+    map->rehash_index = 0;
+    map->bundles = map->next_bundles;
+    map->capacity = map->next_capacity;
+    map->deleted = 0;
+    map->next_bundles = NULL;
+  }
+
+  if (map->old_bundles == NULL) {
+    return;
+  }
+
+  fstd_map_t old_map = fstd__map_old(map);
+
+  size_t end = map->old_capacity;
+  if (count < end - map->rehash_index) {
+    end = map->rehash_index + count;
+  }
+
+  for (; map->rehash_index < end; map->rehash_index++) {
+    if (*FSTD__MAP_BUNDLE_STATE(&old_map, map->rehash_index) ==
+        FSTD__MAP_VALUE_FILLED) {
+      fstd__map_move(map, &old_map, map->rehash_index);
+    }
+  }
+
+  if (map->rehash_index == map->old_capacity) {
+    map->allocator.free(
+        map->allocator.ctx,
+        map->old_bundles,
+        fstd__map_bundles_size(map, map->old_capacity));
+    map->old_bundles = NULL;
+    map->old_capacity = 0;
+  }
+}
+
+// Starts moving every filled bundle into a new array of `capacity` bundles,
+// leaving the deleted ones behind, and finishes unless rehash_step is set.
+// Returns false when out of memory.
+static bool fstd__map_resize(fstd_map_t *map, size_t capacity) {
+  if (map->next_bundles != NULL || map->old_bundles != NULL) {
+    fstd__map_rehash(map, SIZE_MAX);
+  }
+
+  void *bundles = map->allocator.alloc(
+      map->allocator.ctx, fstd__map_bundles_size(map, capacity));
+  if (bundles == NULL) {
+    return false;
+  }
+
+  map->next_bundles = bundles;
+  map->next_capacity = capacity;
+  map->next_cleared = 0;
+
+  fstd__map_rehash(map, map->rehash_step == 0 ? SIZE_MAX : map->rehash_step);
+  return true;
+}
+
+// Called before adding a bundle. Resizes the map if that would put it past
+// max_load, or if it has emptied below min_load. Returns false when the
+// bundle can't be added without going past max_load, as growing ran out of
+// memory.
+static bool fstd__map_resize_if_needed(fstd_map_t *map) {
+  if (map->next_bundles != NULL) {
+    // The bundles keep filling up past max_load while the new ones are
+    // cleared, but probes need at least one empty bundle to stop at
+    if (map->filled + map->deleted + 2 > map->capacity) {
+      fstd__map_rehash(map, SIZE_MAX);
+    }
+    return true;
+  }
+
+  if (map->max_load < 1.0f &&
+      (float)(map->filled + map->deleted + 1) >
+          (float)map->capacity * map->max_load) {
+    // Only grow when the filled bundles alone need it, otherwise getting rid
+    // of the deleted ones is enough
+    size_t capacity = map->capacity;
+    if ((float)(map->filled + 1) > (float)capacity * map->max_load * 0.5f) {
+      if (capacity == 0) {
+        capacity = map->grouped ? FSTD__MAP_GROUP_SIZE : 1;
+      } else {
+        capacity *= 2;
+      }
+      while ((float)(map->filled + 1) > (float)capacity * map->max_load) {
+        capacity *= 2;
+      }
+    }
+    return fstd__map_resize(map, capacity);
+  }
+
+  size_t capacity = map->capacity;
+  // Never down to 0, as the key being added needs a bundle
+  while ((float)map->filled < (float)capacity * map->min_load &&
+         capacity / 2 >= map->min_capacity && capacity > 1) {
+    capacity /= 2;
+  }
+  if (capacity != map->capacity) {
+    // Staying bigger is fine if shrinking runs out of memory
+    fstd__map_resize(map, capacity);
+  }
+  return true;
+}
+
+void *fstd_map_get(fstd_map_t *map, const char *key) {
+  if (map->next_bundles != NULL || map->old_bundles != NULL) {
+    fstd__map_rehash(map, map->rehash_step);
+  }
+
+  size_t hash = (size_t)map->hash_fn(key, map->seed);
+  size_t index = fstd__map_find(map, key, hash);
+  if (index != SIZE_MAX) {
+    return FSTD__MAP_BUNDLE_VALUE(map, index);
+  }
+
+  if (map->old_bundles != NULL) {
+    fstd_map_t old_map = fstd__map_old(map);
+    index = fstd__map_find(&old_map, key, hash);
+    if (index != SIZE_MAX) {
+      return FSTD__MAP_BUNDLE_VALUE(&old_map, index);
+    }
+  }
+
+  return NULL;
 }
 
 void *fstd_map_get_by_index(fstd_map_t *map, size_t index, char **key) {
+  // Indices only cover the new bundles
+  if (map->old_bundles != NULL) {
+    fstd__map_rehash(map, SIZE_MAX);
+  }
+
   fstd__map_value_state_t *bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
 
   if (*bundle_state != FSTD__MAP_VALUE_FILLED) {
@@ -146,101 +787,119 @@ char *fstd_map_get_key(fstd_map_t *map, void *value) {
 }
 
 void *fstd_map_set(fstd_map_t *map, const char *key, void *value) {
-  size_t hash = fstd__djb_hash(key);
-  size_t index = hash % map->capacity;
-  size_t index_start = index;
-
-  char **bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-  fstd__map_value_state_t *bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-  char *bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
-
-  size_t first_deleted = SIZE_MAX;
+  if (map->next_bundles != NULL || map->old_bundles != NULL) {
+    fstd__map_rehash(map, map->rehash_step);
+  }
 
-  char *existing_value = NULL;
+  size_t hash = (size_t)map->hash_fn(key, map->seed);
+  size_t index = fstd__map_find(map, key, hash);
 
-  while (*bundle_state != FSTD__MAP_VALUE_EMPTY) {
-    // Collision!
-    if (first_deleted == SIZE_MAX && *bundle_state == FSTD__MAP_VALUE_DELETED) {
-      first_deleted = index;
+  if (index == SIZE_MAX && map->old_bundles != NULL) {
+    fstd_map_t old_map = fstd__map_old(map);
+    size_t old_index = fstd__map_find(&old_map, key, hash);
+    if (old_index != SIZE_MAX) {
+      // Move it now, so it's only ever in the new bundles once set
+      index = fstd__map_move(map, &old_map, old_index);
     }
+  }
 
-    if (*bundle_key != NULL && strcmp(*bundle_key, key) == 0) {
-      existing_value = bundle_value;
-      break;
+  if (index == SIZE_MAX) {
+    if (!fstd__map_resize_if_needed(map)) {
+      return NULL;
     }
 
-    index = (index + 1) % map->capacity;
-
-    bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-    bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-    bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
-
-    if (index == index_start) {
-      break;
+    index = fstd__map_find_slot(map, hash);
+    if (index == SIZE_MAX) {
+      // Can't add a new element, we're at capacity
+      return NULL;
     }
-  }
 
-  if (!existing_value && map->filled == map->capacity) {
-    // Can't add a new element, we're at capacity
-    return NULL;
-  }
+    size_t key_size = strlen(key) + 1;
+    char *key_copy = map->allocator.alloc(map->allocator.ctx, key_size);
+    if (key_copy == NULL) {
+      return NULL;
+    }
+    memcpy(key_copy, key, key_size);
 
-  if (!existing_value && first_deleted != SIZE_MAX) {
-    bundle_key = FSTD__MAP_BUNDLE_KEY(map, first_deleted);
-    bundle_state = FSTD__MAP_BUNDLE_STATE(map, first_deleted);
-    bundle_value = FSTD__MAP_BUNDLE_VALUE(map, first_deleted);
+    if (*FSTD__MAP_BUNDLE_STATE(map, index) == FSTD__MAP_VALUE_DELETED) {
+      map->deleted--;
+    }
+    *FSTD__MAP_BUNDLE_KEY(map, index) = key_copy;
+    fstd__map_fill(map, index, hash);
+    map->filled++;
   }
 
-  *bundle_key = calloc(1, strlen(key) + 1);
-  strncpy(*bundle_key, key, strlen(key) + 1);
+  char *bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
   memcpy(bundle_value, value, map->value_size);
 
-  if (*bundle_state != FSTD__MAP_VALUE_FILLED) {
-    map->filled++;
-    *bundle_state = FSTD__MAP_VALUE_FILLED;
-  }
-
   return bundle_value;
 }
 
 void *fstd_map_remove(fstd_map_t *map, const char *key) {
-  size_t hash = fstd__djb_hash(key);
-  size_t index = hash % map->capacity;
-  size_t index_start = index;
-
-  char **bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-  fstd__map_value_state_t *bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-  char *bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
-
-  while (*bundle_key == NULL || strcmp(*bundle_key, key) != 0) {
-    index = (index + 1) % map->capacity;
-
-    bundle_key = FSTD__MAP_BUNDLE_KEY(map, index);
-    bundle_state = FSTD__MAP_BUNDLE_STATE(map, index);
-    bundle_value = FSTD__MAP_BUNDLE_VALUE(map, index);
+  if (map->next_bundles != NULL || map->old_bundles != NULL) {
+    fstd__map_rehash(map, map->rehash_step);
+  }
 
-    if (index == index_start) {
-      return NULL;
-    }
+  size_t hash = (size_t)map->hash_fn(key, map->seed);
+  fstd_map_t old_map;
+  fstd_map_t *table = map;
+  size_t index = fstd__map_find(map, key, hash);
+  if (index == SIZE_MAX && map->old_bundles != NULL) {
+    old_map = fstd__map_old(map);
+    table = &old_map;
+    index = fstd__map_find(table, key, hash);
+  }
+  if (index == SIZE_MAX) {
+    return NULL;
   }
 
-  *bundle_state = FSTD__MAP_VALUE_DELETED;
-  free(*bundle_key);
-  *bundle_key = NULL;
+  char **bundle_key = FSTD__MAP_BUNDLE_KEY(table, index);
+  map->allocator.free(
+      map->allocator.ctx, *bundle_key, strlen(*bundle_key) + 1);
+
+  bool deleted = fstd__map_erase(table, index);
   map->filled--;
+  if (table == map && deleted) {
+    map->deleted++;
+  }
 
-  return bundle_value;
+  return FSTD__MAP_BUNDLE_VALUE(table, index);
 }
 
-void fstd_map_destroy(fstd_map_t *map) {
+// Frees the keys and bundles of `map`, or of the old bundles it views
+static void fstd__map_free_bundles(fstd_map_t *map) {
+  if (map->bundles == NULL) {
+    return;
+  }
+
   for (size_t i = 0; i < map->capacity; i++) {
     char **bundle_key = FSTD__MAP_BUNDLE_KEY(map, i);
     if (*bundle_key != NULL) {
-      free(*bundle_key);
+      map->allocator.free(
+          map->allocator.ctx, *bundle_key, strlen(*bundle_key) + 1);
     }
   }
 
-  free(map->bundles);
+  map->allocator.free(
+      map->allocator.ctx,
+      map->bundles,
+      fstd__map_bundles_size(map, map->capacity));
+}
+
+void fstd_map_destroy(fstd_map_t *map) {
+  if (map->next_bundles != NULL) {
+    map->allocator.free(
+        map->allocator.ctx,
+        map->next_bundles,
+        fstd__map_bundles_size(map, map->next_capacity));
+  }
+
+  if (map->old_bundles != NULL) {
+    fstd_map_t old_map = fstd__map_old(map);
+    fstd__map_free_bundles(&old_map);
+  }
+
+  fstd__map_free_bundles(map);
 }
 
 #endif // FSTD_MAP_IMPLEMENTATION
@@ -0,0 +1,215 @@
+#ifndef FSTD_POOL_H
+#define FSTD_POOL_H
+
+/*
+ * Fixed-size object pool. Storage is allocated in chunks that are carved
+ * into equal slots, and unused slots are threaded into an intrusive free
+ * list, so alloc and free are a pointer pop/push.
+ *
+ * NOTE: the library is not thread safe. You will have to handle that yourself.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FSTD__POOL_ALIGNMENT 16
+
+typedef struct fstd_pool_chunk_t {
+  struct fstd_pool_chunk_t *next;
+  size_t slot_count;
+} fstd_pool_chunk_t;
+
+typedef struct fstd_pool_options_t {
+  size_t slot_size;
+  // Power of two, 0 means FSTD__POOL_ALIGNMENT
+  size_t alignment;
+  // Slots in the first chunk
+  size_t chunk_slots;
+  // Every new chunk doubles its slot count up to this. 0 means all chunks
+  // have chunk_slots slots.
+  size_t max_chunk_slots;
+} fstd_pool_options_t;
+
+typedef struct fstd_pool_t {
+  fstd_pool_chunk_t *chunks;
+  void *free_list;
+  // Slots of the newest chunk that were never handed out
+  uint8_t *bump;
+  uint8_t *bump_end;
+  size_t slot_size;
+  size_t alignment;
+  size_t chunk_slots; // Slots in the next chunk
+  size_t max_chunk_slots;
+  size_t chunk_count;
+  size_t slot_count;
+  size_t used_count;
+} fstd_pool_t;
+
+typedef struct fstd_pool_stats_t {
+  size_t slot_size;
+  size_t chunk_count;
+  size_t slot_count;
+  size_t used_count;
+  size_t reserved_bytes;
+} fstd_pool_stats_t;
+
+void fstd_pool_init(fstd_pool_t *pool, size_t slot_size, size_t chunk_slots);
+
+void fstd_pool_init_with_options(
+    fstd_pool_t *pool, const fstd_pool_options_t *options);
+
+void fstd_pool_destroy(fstd_pool_t *pool);
+
+void *fstd_pool_alloc(fstd_pool_t *pool);
+
+void fstd_pool_free(fstd_pool_t *pool, void *ptr);
+
+void fstd_pool_stats(fstd_pool_t *pool, fstd_pool_stats_t *stats);
+
+#ifdef FSTD_POOL_IMPLEMENTATION
+
+#include <assert.h>
+#include <stdlib.h>
+
+static inline size_t fstd__pool_chunk_bytes(fstd_pool_t *pool, size_t slots) {
+  // Room to align the first slot after the chunk header
+  return sizeof(fstd_pool_chunk_t) + pool->alignment - 1 +
+         slots * pool->slot_size;
+}
+
+static inline bool fstd__pool_grow(fstd_pool_t *pool) {
+  size_t slots = pool->chunk_slots;
+
+  fstd_pool_chunk_t *chunk =
+      (fstd_pool_chunk_t *)malloc(fstd__pool_chunk_bytes(pool, slots));
+  if (chunk == NULL) {
+    return false;
+  }
+
+  chunk->next = pool->chunks;
+  chunk->slot_count = slots;
+  pool->chunks = chunk;
+
+  uintptr_t first = (uintptr_t)(chunk + 1);
+  first = (first + pool->alignment - 1) & ~(uintptr_t)(pool->alignment - 1);
+  pool->bump = (uint8_t *)first;
+  pool->bump_end = pool->bump + slots * pool->slot_size;
+
+  pool->chunk_count++;
+  pool->slot_count += slots;
+
+  if (pool->chunk_slots * 2 <= pool->max_chunk_slots) {
+    pool->chunk_slots *= 2;
+  } else if (pool->chunk_slots < pool->max_chunk_slots) {
+    pool->chunk_slots = pool->max_chunk_slots;
+  }
+
+  return true;
+}
+
+void fstd_pool_init(fstd_pool_t *pool, size_t slot_size, size_t chunk_slots) {
+  fstd_pool_options_t options = {0};
+  options.slot_size = slot_size;
+  options.chunk_slots = chunk_slots;
+  fstd_pool_init_with_options(pool, &options);
+}
+
+void fstd_pool_init_with_options(
+    fstd_pool_t *pool, const fstd_pool_options_t *options) {
+  size_t alignment = options->alignment;
+  if (alignment == 0) {
+    alignment = FSTD__POOL_ALIGNMENT;
+  }
+  assert((alignment & (alignment - 1)) == 0);
+  assert(options->chunk_slots > 0);
+
+  // Free slots hold the free list link
+  size_t slot_size = options->slot_size;
+  if (slot_size < sizeof(void *)) {
+    slot_size = sizeof(void *);
+  }
+  if (alignment < sizeof(void *)) {
+    alignment = sizeof(void *);
+  }
+
+  pool->chunks = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  pool->slot_size = (slot_size + alignment - 1) & ~(alignment - 1);
+  pool->alignment = alignment;
+  pool->chunk_slots = options->chunk_slots;
+  pool->max_chunk_slots = options->max_chunk_slots;
+  pool->chunk_count = 0;
+  pool->slot_count = 0;
+  pool->used_count = 0;
+}
+
+void fstd_pool_destroy(fstd_pool_t *pool) {
+  fstd_pool_chunk_t *chunk = pool->chunks;
+  while (chunk != NULL) {
+    fstd_pool_chunk_t *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+
+  pool->chunks = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+}
+
+void *fstd_pool_alloc(fstd_pool_t *pool) {
+  void *slot = pool->free_list;
+
+  if (slot != NULL) {
+    pool->free_list = *(void **)slot;
+  } else {
+    if (pool->bump == pool->bump_end && !fstd__pool_grow(pool)) {
+      return NULL;
+    }
+
+    slot = pool->bump;
+    pool->bump += pool->slot_size;
+  }
+
+  pool->used_count++;
+  return slot;
+}
+
+void fstd_pool_free(fstd_pool_t *pool, void *ptr) {
+  if (ptr == NULL) {
+    return;
+  }
+
+  assert(pool->used_count > 0);
+  *(void **)ptr = pool->free_list;
+  pool->free_list = ptr;
+  pool->used_count--;
+}
+
+void fstd_pool_stats(fstd_pool_t *pool, fstd_pool_stats_t *stats) {
+  stats->slot_size = pool->slot_size;
+  stats->chunk_count = pool->chunk_count;
+  stats->slot_count = pool->slot_count;
+  stats->used_count = pool->used_count;
+  stats->reserved_bytes = 0;
+
+  for (fstd_pool_chunk_t *chunk = pool->chunks; chunk != NULL;
+       chunk = chunk->next) {
+    stats->reserved_bytes += fstd__pool_chunk_bytes(pool, chunk->slot_count);
+  }
+}
+
+#endif // FSTD_POOL_IMPLEMENTATION
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
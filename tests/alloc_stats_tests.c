@@ -0,0 +1,149 @@
+// Built on its own, as FSTD_ALLOC_STATS changes fstd_allocator_t
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#define FSTD_ALLOC_STATS
+#define FSTD_ALLOC_IMPLEMENTATION
+#include <fstd_alloc.h>
+#include <string.h>
+#include <unity.h>
+
+static fstd_allocator_counters_t counters(fstd_allocator_t *allocator) {
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(allocator, &stats);
+  return stats.counters;
+}
+
+void test_stats_counters() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+
+  uint8_t *small1 = fstd_alloc(&allocator, 100);
+  uint8_t *small2 = fstd_alloc(&allocator, 100);
+  size_t small_size = FSTD_ALLOC_CHUNK_SIZE(100) - sizeof(fstd_alloc_header_t);
+
+  fstd_allocator_counters_t c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(2, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(0, c.large_allocs);
+  TEST_ASSERT_EQUAL_UINT32(0, c.blocks_added);
+  TEST_ASSERT_EQUAL_UINT32(2 * small_size, c.live_bytes);
+
+  // Shrinking in place
+  small1 = fstd_realloc(&allocator, small1, 16);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(1, c.reallocs);
+  TEST_ASSERT_EQUAL_UINT32(1, c.reallocs_in_place);
+  TEST_ASSERT_EQUAL_UINT32(2, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(0, c.frees);
+
+  // A mapping of its own, grown by remapping
+  uint8_t *large = fstd_alloc(&allocator, 1 << 16);
+  large = fstd_realloc(&allocator, large, 1 << 17);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(3, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(1, c.large_allocs);
+  TEST_ASSERT_EQUAL_UINT32(2, c.reallocs);
+  TEST_ASSERT_EQUAL_UINT32(2, c.reallocs_in_place);
+  TEST_ASSERT(c.live_bytes >= (1 << 17));
+  size_t peak_bytes = c.live_bytes;
+
+  // Only fits in a block of its own
+  uint8_t *big = fstd_alloc(&allocator, FSTD_ALLOC_MAX_SIZE(4096));
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(4, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(1, c.blocks_added);
+
+  fstd_free(&allocator, small1);
+  fstd_free(&allocator, small2);
+  fstd_free(&allocator, large);
+  fstd_free(&allocator, big);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(4, c.frees);
+  TEST_ASSERT_EQUAL_UINT32(0, c.live_bytes);
+  TEST_ASSERT(c.peak_bytes >= peak_bytes);
+
+  // Aligned past a page, so it's copied to a new mapping instead
+  uint8_t *aligned = fstd_alloc_aligned(&allocator, 1 << 16, 1 << 16);
+  aligned = fstd_realloc_aligned(&allocator, aligned, 1 << 17, 1 << 16);
+  TEST_ASSERT_EQUAL_UINT32(3, counters(&allocator).reallocs);
+  TEST_ASSERT_EQUAL_UINT32(2, counters(&allocator).reallocs_in_place);
+  fstd_free(&allocator, aligned);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_stats_batch() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+
+  void *ptrs[16];
+  TEST_ASSERT_EQUAL_UINT32(16, fstd_alloc_batch(&allocator, 32, 16, ptrs));
+  fstd_allocator_counters_t c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(16, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(
+      16 * (FSTD_ALLOC_CHUNK_SIZE(32) - sizeof(fstd_alloc_header_t)),
+      c.live_bytes);
+
+  fstd_free_batch(&allocator, ptrs, 16);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(16, c.frees);
+  TEST_ASSERT_EQUAL_UINT32(0, c.live_bytes);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_stats_slabs() {
+  fstd_allocator_t allocator;
+  fstd_allocator_options_t options = {0};
+  options.block_size = 4096;
+  options.slab_max_size = FSTD_ALLOC_SLAB_MAX_SIZE;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  void *slot = fstd_alloc(&allocator, 24);
+  fstd_allocator_counters_t c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(1, c.allocs);
+  TEST_ASSERT_EQUAL_UINT32(32, c.live_bytes);
+
+  // Fits the slot it's in
+  slot = fstd_realloc(&allocator, slot, 30);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(1, c.reallocs_in_place);
+
+  fstd_free(&allocator, slot);
+  c = counters(&allocator);
+  TEST_ASSERT_EQUAL_UINT32(1, c.frees);
+  TEST_ASSERT_EQUAL_UINT32(0, c.live_bytes);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_stats_decommit() {
+  fstd_allocator_t allocator;
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 16;
+  options.decommit_after_frees = 1;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  // The second block's free comes after the first became empty
+  uint8_t *fill = fstd_alloc(&allocator, FSTD_ALLOC_MAX_SIZE(1 << 16));
+  uint8_t *small = fstd_alloc(&allocator, 64);
+  memset(fill, 1, FSTD_ALLOC_MAX_SIZE(1 << 16));
+  fstd_free(&allocator, fill);
+  TEST_ASSERT_EQUAL_UINT32(0, counters(&allocator).blocks_decommitted);
+  fstd_free(&allocator, small);
+  TEST_ASSERT_EQUAL_UINT32(1, counters(&allocator).blocks_decommitted);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+int main() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_stats_counters);
+  RUN_TEST(test_stats_batch);
+  RUN_TEST(test_stats_slabs);
+  RUN_TEST(test_stats_decommit);
+
+  return UNITY_END();
+}
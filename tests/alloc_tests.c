@@ -1,5 +1,8 @@
 #include <assert.h>
 #include <fstd_alloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unity.h>
 
 typedef FSTD__ALLOC_ALIGNAS(16) struct vec4_t { float v[4]; } vec4_t;
@@ -11,27 +14,18 @@ uint32_t header_count(fstd_alloc_block_t *block) {
   fstd_alloc_header_t *header = block->first_header;
   while (header != NULL) {
     headers++;
-    header = header->next;
+    header = fstd_alloc_header_next(header);
   }
 
   return headers;
 }
 
 uint32_t block_count(fstd_allocator_t *allocator) {
-  uint32_t blocks = 0;
-
-  fstd_alloc_block_t *block = allocator->last_block;
-  while (block != NULL) {
-    blocks++;
-    block = block->prev;
-  }
-
-  return blocks;
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(allocator, &stats);
+  return (uint32_t)stats.block_count;
 }
 
-#define BLOCK_SIZE(alloc_size, count)                                          \
-  ((sizeof(fstd_alloc_header_t) + (alloc_size)) * count)
-
 void test_create_destroy() {
   fstd_allocator_t allocator;
   fstd_allocator_init(&allocator, 120);
@@ -118,7 +112,7 @@ void test_alloc_multi_block() {
   size_t alloc_size = FSTD__ALLOC_ALIGNMENT;
 
   fstd_allocator_init(
-      &allocator, (sizeof(fstd_alloc_header_t) + alloc_size) * per_block);
+      &allocator, FSTD_ALLOC_BLOCK_SIZE(alloc_size, per_block));
 
   for (uint32_t i = 0; i < per_block * 20; i++) {
     uint64_t *alloc = fstd_alloc(&allocator, alloc_size);
@@ -135,19 +129,145 @@ void test_alloc_too_big() {
   fstd_allocator_init(&allocator, 160);
 
   {
-    uint64_t *alloc = fstd_alloc(&allocator, 160);
-    TEST_ASSERT(alloc == NULL);
+    // Served from its own mapping
+    uint8_t *alloc = fstd_alloc(&allocator, 160);
+    TEST_ASSERT(alloc != NULL);
+    TEST_ASSERT((uintptr_t)alloc % FSTD__ALLOC_ALIGNMENT == 0);
+    memset(alloc, 1, 160);
+    TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+    fstd_free(&allocator, alloc);
   }
 
   {
-    uint64_t *alloc = fstd_alloc(&allocator, 10000);
-    TEST_ASSERT(alloc == NULL);
+    uint8_t *alloc = fstd_alloc(&allocator, 10000);
+    TEST_ASSERT(alloc != NULL);
+    memset(alloc, 1, 10000);
+    TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
   }
 
   {
     uint64_t *alloc = fstd_alloc(
-        &allocator, allocator.block_size - sizeof(fstd_alloc_header_t));
+        &allocator, FSTD_ALLOC_MAX_SIZE(allocator.block_size));
+    TEST_ASSERT(alloc != NULL);
+    TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+  }
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_large_realloc() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_init(&allocator, 160);
+
+  uint32_t *alloc = fstd_alloc(&allocator, sizeof(uint32_t) * 4);
+  TEST_ASSERT(alloc != NULL);
+  for (uint32_t i = 0; i < 4; i++) {
+    alloc[i] = i;
+  }
+
+  // From a block to a mapping
+  size_t count = 1024;
+  alloc = fstd_realloc(&allocator, alloc, sizeof(uint32_t) * count);
+  TEST_ASSERT(alloc != NULL);
+  for (uint32_t i = 4; i < count; i++) {
+    alloc[i] = i;
+  }
+
+  // Growing a mapping
+  alloc = fstd_realloc(&allocator, alloc, sizeof(uint32_t) * count * 64);
+  TEST_ASSERT(alloc != NULL);
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(alloc[i], i);
+  }
+
+  // Back into a block
+  alloc = fstd_realloc(&allocator, alloc, sizeof(uint32_t) * 2);
+  TEST_ASSERT(alloc != NULL);
+  TEST_ASSERT_EQUAL_UINT32(alloc[0], 0);
+  TEST_ASSERT_EQUAL_UINT32(alloc[1], 1);
+  TEST_ASSERT(allocator.large_list == NULL);
+
+  fstd_free(&allocator, alloc);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_aligned_custom() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1 << 14);
+
+  size_t aligns[] = {1, 16, 32, 64, 256, 4096};
+  for (uint32_t i = 0; i < sizeof(aligns) / sizeof(aligns[0]); i++) {
+    // Unaligned allocation in between, so the next one has to be moved
+    TEST_ASSERT(fstd_alloc(&allocator, 8) != NULL);
+
+    uint8_t *alloc = fstd_alloc_aligned(&allocator, 100, aligns[i]);
+    TEST_ASSERT(alloc != NULL);
+    TEST_ASSERT((uintptr_t)alloc % aligns[i] == 0);
+    memset(alloc, 1, 100);
+  }
+
+  // The bytes skipped to align are given back
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  // Bigger than a block
+  uint8_t *large = fstd_alloc_aligned(&allocator, 1 << 15, 1 << 13);
+  TEST_ASSERT(large != NULL);
+  TEST_ASSERT((uintptr_t)large % (1 << 13) == 0);
+  memset(large, 1, 1 << 15);
+  fstd_free(&allocator, large);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_realloc_aligned() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1 << 14);
+
+  uint32_t *alloc = fstd_alloc(&allocator, sizeof(uint32_t) * 4);
+  TEST_ASSERT(alloc != NULL);
+  for (uint32_t i = 0; i < 4; i++) {
+    alloc[i] = i;
+  }
+
+  alloc = fstd_realloc_aligned(&allocator, alloc, sizeof(uint32_t) * 64, 256);
+  TEST_ASSERT(alloc != NULL);
+  TEST_ASSERT((uintptr_t)alloc % 256 == 0);
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT32(alloc[i], i);
+  }
+
+  // Growing keeps the alignment, in place or not
+  alloc = fstd_realloc_aligned(&allocator, alloc, sizeof(uint32_t) * 512, 256);
+  TEST_ASSERT(alloc != NULL);
+  TEST_ASSERT((uintptr_t)alloc % 256 == 0);
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT32(alloc[i], i);
+  }
+
+  fstd_free(&allocator, alloc);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_realloc_aligned_large() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+
+  // The payload of an aligned mapping starts further in than a plain one's,
+  // so reallocating without the alignment still has to make room for that
+  size_t sizes[][3] = {{1389, 4096, 4615}, {7711, 2048, 31233}};
+  for (uint32_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    uint8_t *alloc = fstd_alloc_aligned(&allocator, sizes[i][0], sizes[i][1]);
+    TEST_ASSERT(alloc != NULL);
+    TEST_ASSERT((uintptr_t)alloc % sizes[i][1] == 0);
+    memset(alloc, 1, sizes[i][0]);
+
+    alloc = fstd_realloc(&allocator, alloc, sizes[i][2]);
     TEST_ASSERT(alloc != NULL);
+    TEST_ASSERT_EQUAL_UINT8(1, alloc[sizes[i][0] - 1]);
+    memset(alloc, 2, sizes[i][2]);
+
+    fstd_free(&allocator, alloc);
   }
 
   fstd_allocator_destroy(&allocator);
@@ -160,12 +280,12 @@ void test_alloc_free() {
 
   {
     void *alloc1 = fstd_alloc(
-        &allocator, allocator.block_size - sizeof(fstd_alloc_header_t));
+        &allocator, FSTD_ALLOC_MAX_SIZE(allocator.block_size));
     TEST_ASSERT(alloc1 != NULL);
     fstd_free(&allocator, alloc1);
 
     void *alloc2 = fstd_alloc(
-        &allocator, allocator.block_size - sizeof(fstd_alloc_header_t));
+        &allocator, FSTD_ALLOC_MAX_SIZE(allocator.block_size));
     TEST_ASSERT(alloc2 != NULL);
 
     TEST_ASSERT(alloc1 == alloc2);
@@ -190,7 +310,7 @@ void test_alloc_realloc_grow() {
     TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
 
     uint32_t *alloc3 = fstd_realloc(
-        &allocator, alloc2, allocator.block_size - sizeof(fstd_alloc_header_t));
+        &allocator, alloc2, FSTD_ALLOC_MAX_SIZE(allocator.block_size));
     TEST_ASSERT(alloc3 != NULL);
     TEST_ASSERT(alloc3 == alloc2);
     TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
@@ -213,7 +333,7 @@ void test_alloc_realloc_fragmented() {
     TEST_ASSERT(alloc2 != NULL);
 
     uint32_t *alloc3 =
-        fstd_realloc(&allocator, alloc1, FSTD__ALLOC_ALIGNMENT + 1);
+        fstd_realloc(&allocator, alloc1, FSTD__ALLOC_ALIGNMENT * 4);
     TEST_ASSERT(alloc3 != NULL);
     TEST_ASSERT(alloc3 != alloc1);
     TEST_ASSERT(*alloc3 == 3);
@@ -222,6 +342,969 @@ void test_alloc_realloc_fragmented() {
   fstd_allocator_destroy(&allocator);
 }
 
+void test_alloc_realloc_shrink() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1024);
+
+  uint8_t *alloc1 = fstd_alloc(&allocator, 512);
+  uint8_t *alloc2 = fstd_alloc(&allocator, 16);
+  memset(alloc1, 7, 32);
+
+  uint8_t *alloc3 = fstd_realloc(&allocator, alloc1, 32);
+  TEST_ASSERT_EQUAL_PTR(alloc1, alloc3);
+  TEST_ASSERT_EQUAL_UINT8(alloc3[31], 7);
+
+  // Only the tail that was given back is big enough for this
+  size_t tail_size = FSTD_ALLOC_CHUNK_SIZE(512) - FSTD_ALLOC_CHUNK_SIZE(32);
+  uint8_t *alloc4 =
+      fstd_alloc(&allocator, tail_size - sizeof(fstd_alloc_header_t));
+  TEST_ASSERT_EQUAL_PTR(alloc3 + FSTD_ALLOC_CHUNK_SIZE(32), alloc4);
+  TEST_ASSERT(alloc4 < alloc2);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_realloc_backward() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1024);
+
+  uint8_t *alloc1 = fstd_alloc(&allocator, 128);
+  uint8_t *alloc2 = fstd_alloc(&allocator, 128);
+  fstd_alloc(&allocator, 16);
+  for (uint32_t i = 0; i < 128; i++) {
+    alloc2[i] = (uint8_t)i;
+  }
+  fstd_free(&allocator, alloc1);
+
+  // The next header is used, so it grows into the free one before it
+  uint8_t *alloc3 = fstd_realloc(&allocator, alloc2, 200);
+  TEST_ASSERT_EQUAL_PTR(alloc1, alloc3);
+  for (uint32_t i = 0; i < 128; i++) {
+    TEST_ASSERT_EQUAL_UINT8(alloc3[i], i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_reuse_freed() {
+  fstd_allocator_t allocator;
+
+  uint32_t count = 4096;
+  fstd_allocator_init(&allocator, FSTD_ALLOC_BLOCK_SIZE(32, count));
+
+  uint32_t **allocs = malloc(sizeof(*allocs) * count);
+  for (uint32_t i = 0; i < count; i++) {
+    allocs[i] = fstd_alloc(&allocator, 32);
+    TEST_ASSERT(allocs[i] != NULL);
+    *allocs[i] = i;
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  for (uint32_t i = 0; i < count; i += 2) {
+    fstd_free(&allocator, allocs[i]);
+  }
+
+  // Freed headers are reused before a new block is created
+  for (uint32_t i = 0; i < count; i += 2) {
+    allocs[i] = fstd_alloc(&allocator, 32);
+    TEST_ASSERT(allocs[i] != NULL);
+    *allocs[i] = i;
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(*allocs[i], i);
+  }
+
+  free(allocs);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_batch() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+
+  uint32_t count = 1000;
+  uint32_t **allocs = malloc(sizeof(*allocs) * count);
+  TEST_ASSERT_EQUAL_UINT32(
+      fstd_alloc_batch(&allocator, 24, count, (void **)allocs), count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT((uintptr_t)allocs[i] % FSTD__ALLOC_ALIGNMENT == 0);
+    memset(allocs[i], 0, 24);
+    *allocs[i] = i;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT32(*allocs[i], i);
+  }
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, count);
+
+  // Free some one by one so the batch has to merge with binned headers too,
+  // and shuffle the rest
+  for (uint32_t i = 0; i < count; i += 7) {
+    fstd_free(&allocator, allocs[i]);
+    allocs[i] = allocs[--count];
+  }
+  uint64_t rng = 1;
+  for (uint32_t i = count - 1; i > 0; i--) {
+    rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+    uint32_t j = (uint32_t)((rng >> 33) % (i + 1));
+    uint32_t *tmp = allocs[i];
+    allocs[i] = allocs[j];
+    allocs[j] = tmp;
+  }
+  allocs[count++] = fstd_alloc(&allocator, allocator.block_size);
+
+  fstd_free_batch(&allocator, (void **)allocs, count);
+
+  // Every block is a single free header again
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 0);
+  TEST_ASSERT_EQUAL_UINT32(stats.free_count, stats.block_count);
+
+  free(allocs);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_tlsf() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 14;
+  options.fit = FSTD_ALLOC_FIT_TLSF;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  void *allocs[64];
+  for (uint32_t i = 0; i < 64; i++) {
+    allocs[i] = fstd_alloc(&allocator, 16 + i * 3);
+    TEST_ASSERT(allocs[i] != NULL);
+    TEST_ASSERT((uintptr_t)allocs[i] % FSTD__ALLOC_ALIGNMENT == 0);
+    memset(allocs[i], (int)i, 16 + i * 3);
+  }
+
+  for (uint32_t i = 0; i < 64; i += 2) {
+    fstd_free(&allocator, allocs[i]);
+  }
+
+  for (uint32_t i = 1; i < 64; i += 2) {
+    uint8_t *bytes = allocs[i];
+    for (uint32_t j = 0; j < 16 + i * 3; j++) {
+      TEST_ASSERT_EQUAL_UINT8(bytes[j], i);
+    }
+    fstd_free(&allocator, allocs[i]);
+  }
+
+  // Everything was merged back into a single header
+  TEST_ASSERT_EQUAL_UINT32(header_count(allocator.last_block), 1);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  void *alloc = fstd_alloc(
+      &allocator, FSTD_ALLOC_MAX_SIZE(allocator.block_size));
+  TEST_ASSERT(alloc != NULL);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_fit_policies() {
+  fstd_alloc_fit_t fits[] = {
+      FSTD_ALLOC_FIT_FIRST,
+      FSTD_ALLOC_FIT_NEXT,
+      FSTD_ALLOC_FIT_BEST,
+  };
+
+  for (uint32_t i = 0; i < 3; i++) {
+    for (uint32_t round = 0; round < 2; round++) {
+      fstd_allocator_t allocator;
+
+      fstd_allocator_options_t options = {0};
+      options.block_size = 4096;
+      options.fit = fits[i];
+      fstd_allocator_init_with_options(&allocator, &options);
+
+      // Free headers of 512, 528 (same size class) and 64 bytes, kept apart
+      // by used ones. The 528 byte one is freed last.
+      void *a = fstd_alloc(&allocator, 508);
+      fstd_alloc(&allocator, 16);
+      void *b = fstd_alloc(&allocator, 524);
+      fstd_alloc(&allocator, 16);
+      void *c = fstd_alloc(&allocator, 60);
+      fstd_alloc(&allocator, 16);
+      fstd_free(&allocator, c);
+      fstd_free(&allocator, a);
+      fstd_free(&allocator, b);
+
+      if (round == 0) {
+        void *expected[] = {b, b, a};
+        TEST_ASSERT_EQUAL_PTR(expected[i], fstd_alloc(&allocator, 508));
+      } else {
+        void *expected[] = {c, b, c};
+        TEST_ASSERT_EQUAL_PTR(expected[i], fstd_alloc(&allocator, 60));
+      }
+
+      fstd_allocator_destroy(&allocator);
+    }
+  }
+}
+
+uint32_t arena_block_count(fstd_arena_t *arena) {
+  uint32_t blocks = 0;
+
+  fstd_alloc_block_t *block = &arena->base_block;
+  while (block != NULL) {
+    blocks++;
+    block = block->next;
+  }
+
+  return blocks;
+}
+
+void test_alloc_trim() {
+  fstd_allocator_t allocator;
+
+  size_t max_alloc = FSTD_ALLOC_MAX_SIZE(1024);
+  fstd_allocator_init(&allocator, 1024);
+
+  void *allocs[4];
+  for (uint32_t i = 0; i < 4; i++) {
+    allocs[i] = fstd_alloc(&allocator, max_alloc);
+    TEST_ASSERT(allocs[i] != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 4);
+
+  // Blocks that are still in use are kept
+  TEST_ASSERT_EQUAL_UINT32(fstd_allocator_trim(&allocator, 0), 0);
+
+  fstd_free(&allocator, allocs[1]);
+  fstd_free(&allocator, allocs[3]);
+
+  TEST_ASSERT_EQUAL_UINT32(fstd_allocator_trim(&allocator, 1024), 1024);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 3);
+
+  TEST_ASSERT_EQUAL_UINT32(fstd_allocator_trim(&allocator, 0), 1024);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 2);
+
+  // The first block is smaller than a page, so only the other one counts
+  fstd_free(&allocator, allocs[0]);
+  fstd_free(&allocator, allocs[2]);
+  TEST_ASSERT_EQUAL_UINT32(fstd_allocator_trim(&allocator, 0), 1024);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+
+  // Trimmed memory can be allocated again
+  for (uint32_t i = 0; i < 4; i++) {
+    allocs[i] = fstd_alloc(&allocator, max_alloc);
+    TEST_ASSERT(allocs[i] != NULL);
+    memset(allocs[i], 1, max_alloc);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 4);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_decommit() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 16;
+  options.decommit_after_frees = 2;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  size_t max_alloc = FSTD_ALLOC_MAX_SIZE(options.block_size);
+  for (uint32_t i = 0; i < 8; i++) {
+    uint8_t *alloc1 = fstd_alloc(&allocator, max_alloc / 2);
+    uint8_t *alloc2 = fstd_alloc(&allocator, 64);
+    TEST_ASSERT(alloc1 != NULL);
+    TEST_ASSERT(alloc2 != NULL);
+    memset(alloc1, 1, max_alloc / 2);
+    memset(alloc2, 1, 64);
+    fstd_free(&allocator, alloc1);
+    fstd_free(&allocator, alloc2);
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 1);
+  TEST_ASSERT_EQUAL_UINT32(header_count(allocator.last_block), 1);
+
+  // Fills the first block, so the small ones go to a second one which stays
+  // in use while the first has been empty for long enough
+  uint8_t *fill = fstd_alloc(&allocator, max_alloc);
+  TEST_ASSERT(fill != NULL);
+  memset(fill, 1, max_alloc);
+  uint8_t *smalls[3];
+  for (uint32_t i = 0; i < 3; i++) {
+    smalls[i] = fstd_alloc(&allocator, 64);
+    TEST_ASSERT(smalls[i] != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 2);
+
+  fstd_free(&allocator, fill);
+  for (uint32_t i = 0; i < 3; i++) {
+    fstd_free(&allocator, smalls[i]);
+  }
+
+#if defined(__linux__)
+  // Decommitted pages of private memory read back as zeroes
+  TEST_ASSERT_EQUAL_UINT8(0, fill[max_alloc / 2]);
+#endif
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_mapped_storage() {
+  fstd_alloc_storage_t storages[] = {
+      FSTD_ALLOC_STORAGE_MAP,
+      FSTD_ALLOC_STORAGE_HUGE_PAGES,
+  };
+
+  for (uint32_t i = 0; i < 2; i++) {
+    fstd_allocator_t allocator;
+
+    fstd_allocator_options_t options = {0};
+    options.block_size = 5000;
+    options.storage = storages[i];
+    fstd_allocator_init_with_options(&allocator, &options);
+
+    // Rounded up to whole pages
+    TEST_ASSERT(allocator.block_size >= 5000);
+    TEST_ASSERT(allocator.block_size % 4096 == 0);
+
+    size_t max_alloc = FSTD_ALLOC_MAX_SIZE(allocator.block_size);
+    for (uint32_t j = 0; j < 3; j++) {
+      uint8_t *alloc = fstd_alloc(&allocator, max_alloc);
+      TEST_ASSERT(alloc != NULL);
+      memset(alloc, 1, max_alloc);
+    }
+    TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 3);
+
+    fstd_allocator_destroy(&allocator);
+  }
+}
+
+void test_alloc_growth() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1024;
+  options.max_block_size = 8192;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  // Everything up to the biggest block stays out of large mappings
+  TEST_ASSERT_EQUAL_UINT32(
+      allocator.large_threshold, FSTD_ALLOC_MAX_SIZE(8192));
+
+  for (uint32_t i = 0; i < 64; i++) {
+    TEST_ASSERT(fstd_alloc(&allocator, 500) != NULL);
+  }
+
+  // Sizes double up to the cap
+  size_t expected_size = 1024;
+  fstd_alloc_block_t *block = &allocator.base_block;
+  while (block != NULL) {
+    TEST_ASSERT_EQUAL_UINT32(block->size, expected_size);
+    if (expected_size < 8192) {
+      expected_size *= 2;
+    }
+    block = block->next;
+  }
+  TEST_ASSERT(block_count(&allocator) < 10);
+
+  // A new block is made big enough for the allocation that needs it
+  void *big = fstd_alloc(&allocator, FSTD_ALLOC_MAX_SIZE(8192));
+  TEST_ASSERT(big != NULL);
+  TEST_ASSERT(allocator.large_list == NULL);
+  TEST_ASSERT_EQUAL_UINT32(allocator.last_block->size, 8192);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_many_blocks() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 64);
+
+  // Enough blocks to overflow the stack if teardown recursed per block
+  uint32_t count = 1 << 18;
+  for (uint32_t i = 0; i < count; i++) {
+    TEST_ASSERT(fstd_alloc(&allocator, FSTD_ALLOC_MAX_SIZE(64)) != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), count);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_alloc_aligned_blocks() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 5000;
+  options.aligned_blocks = true;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  // Rounded up to a power of two
+  TEST_ASSERT_EQUAL_UINT32(allocator.block_size, 8192);
+
+  size_t max_alloc = FSTD_ALLOC_MAX_SIZE(allocator.block_size);
+  for (uint32_t i = 0; i < 3; i++) {
+    uint8_t *alloc = fstd_alloc(&allocator, max_alloc);
+    TEST_ASSERT(alloc != NULL);
+    memset(alloc, 1, max_alloc);
+  }
+  TEST_ASSERT_EQUAL_UINT32(block_count(&allocator), 3);
+
+  fstd_alloc_block_t *block = allocator.last_block;
+  while (block != NULL) {
+    TEST_ASSERT((uintptr_t)block->storage % allocator.block_size == 0);
+    block = block->prev;
+  }
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_heap_remote_free() {
+  fstd_heap_t heap1;
+  fstd_heap_t heap2;
+  fstd_heap_init(&heap1);
+  fstd_heap_init(&heap2);
+
+  uint8_t *small = fstd_heap_alloc(&heap1, 64);
+  uint8_t *large = fstd_heap_alloc(&heap1, FSTD_ALLOC_HEAP_BLOCK_SIZE);
+  TEST_ASSERT(small != NULL);
+  TEST_ASSERT(large != NULL);
+
+  // Goes to heap1's remote free list, not to heap2
+  fstd_heap_free(&heap2, small);
+  fstd_heap_free(&heap2, large);
+  TEST_ASSERT(heap1.remote_frees != NULL);
+  TEST_ASSERT(heap2.remote_frees == NULL);
+  TEST_ASSERT(heap1.allocator.large_list != NULL);
+
+  // Drained by heap1's next allocation
+  uint8_t *alloc = fstd_heap_alloc(&heap1, 64);
+  TEST_ASSERT(heap1.remote_frees == NULL);
+  TEST_ASSERT(heap1.allocator.large_list == NULL);
+  TEST_ASSERT_EQUAL_PTR(small, alloc);
+
+  // Realloc moves memory into the calling thread's heap
+  uint8_t *moved = fstd_heap_realloc(&heap2, alloc, 128);
+  TEST_ASSERT(moved != alloc);
+  fstd_heap_free(&heap2, moved);
+
+  fstd_heap_destroy(&heap1);
+  fstd_heap_destroy(&heap2);
+}
+
+#define HEAP_THREAD_COUNT 4
+#define HEAP_THREAD_ALLOCS 4096
+
+typedef struct heap_thread_t {
+  fstd_heap_t heap;
+  void **allocs;
+} heap_thread_t;
+
+static void *heap_thread_free(void *arg) {
+  heap_thread_t *thread = arg;
+  for (uint32_t i = 0; i < HEAP_THREAD_ALLOCS; i++) {
+    fstd_heap_free(&thread->heap, thread->allocs[i]);
+  }
+  return NULL;
+}
+
+void test_heap_threads() {
+  fstd_heap_t heap;
+  fstd_heap_init(&heap);
+
+  heap_thread_t threads[HEAP_THREAD_COUNT];
+  pthread_t ids[HEAP_THREAD_COUNT];
+
+  for (uint32_t i = 0; i < HEAP_THREAD_COUNT; i++) {
+    fstd_heap_init(&threads[i].heap);
+    threads[i].allocs = malloc(sizeof(void *) * HEAP_THREAD_ALLOCS);
+    for (uint32_t j = 0; j < HEAP_THREAD_ALLOCS; j++) {
+      threads[i].allocs[j] = fstd_heap_alloc(&heap, 16 + j % 256);
+      TEST_ASSERT(threads[i].allocs[j] != NULL);
+    }
+  }
+
+  // Every thread frees into the same remote free list at once
+  for (uint32_t i = 0; i < HEAP_THREAD_COUNT; i++) {
+    pthread_create(&ids[i], NULL, heap_thread_free, &threads[i]);
+  }
+  for (uint32_t i = 0; i < HEAP_THREAD_COUNT; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  fstd_heap_collect(&heap);
+  TEST_ASSERT_EQUAL_UINT32(block_count(&heap.allocator), 1);
+  TEST_ASSERT_EQUAL_UINT32(header_count(heap.allocator.last_block), 1);
+
+  for (uint32_t i = 0; i < HEAP_THREAD_COUNT; i++) {
+    fstd_heap_destroy(&threads[i].heap);
+    free(threads[i].allocs);
+  }
+  fstd_heap_destroy(&heap);
+}
+
+static uint32_t highest_bit(size_t x) {
+  uint32_t bit = 0;
+  while (x >>= 1) {
+    bit++;
+  }
+  return bit;
+}
+
+void test_alloc_stats() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, FSTD_ALLOC_BLOCK_SIZE(100, 4));
+
+  void *allocs[4];
+  for (uint32_t i = 0; i < 4; i++) {
+    allocs[i] = fstd_alloc(&allocator, 100);
+  }
+  void *large = fstd_alloc(&allocator, allocator.block_size);
+  fstd_free(&allocator, allocs[1]);
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+
+  size_t chunk_size = FSTD_ALLOC_CHUNK_SIZE(100);
+  size_t payload_size = chunk_size - sizeof(fstd_alloc_header_t);
+
+  TEST_ASSERT_EQUAL_UINT32(stats.block_count, 1);
+  TEST_ASSERT_EQUAL_UINT32(stats.block_bytes, allocator.block_size);
+  TEST_ASSERT_EQUAL_UINT32(stats.large_count, 1);
+  TEST_ASSERT(stats.large_bytes > allocator.block_size);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 4);
+  TEST_ASSERT(stats.live_bytes >= payload_size * 3 + allocator.block_size);
+  TEST_ASSERT_EQUAL_UINT32(stats.free_count, 1);
+  TEST_ASSERT_EQUAL_UINT32(stats.free_bytes, chunk_size);
+  TEST_ASSERT_EQUAL_UINT32(stats.largest_free, payload_size);
+  TEST_ASSERT_EQUAL_UINT32(
+      stats.overhead_bytes,
+      FSTD_ALLOC_BLOCK_OVERHEAD + 3 * sizeof(fstd_alloc_header_t));
+  TEST_ASSERT_EQUAL_UINT32(
+      stats.free_histogram[highest_bit(chunk_size)], 1);
+  TEST_ASSERT_EQUAL_UINT32(
+      stats.live_histogram[highest_bit(payload_size)], 3);
+
+  // Everything in a block is either live, free or overhead
+  TEST_ASSERT_EQUAL_UINT32(
+      stats.block_bytes,
+      payload_size * 3 + stats.free_bytes + stats.overhead_bytes);
+
+  fstd_free(&allocator, large);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_slab_alloc() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 16;
+  options.slab_max_size = FSTD_ALLOC_SLAB_MAX_SIZE;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  // Enough 24 byte objects for more than one slab
+  uint32_t count = 2 * FSTD_ALLOC_SLAB_SIZE / 32 + 1;
+  uint32_t **allocs = malloc(count * sizeof(uint32_t *));
+  for (uint32_t i = 0; i < count; i++) {
+    allocs[i] = fstd_alloc(&allocator, 24);
+    TEST_ASSERT(allocs[i] != NULL);
+    TEST_ASSERT((uintptr_t)allocs[i] % FSTD__ALLOC_ALIGNMENT == 0);
+    for (uint32_t j = 0; j < 6; j++) {
+      allocs[i][j] = i;
+    }
+  }
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 3);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_bytes, 3 * FSTD_ALLOC_SLAB_SIZE);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, count);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_bytes, count * 32);
+
+  // Nothing was taken from the blocks
+  TEST_ASSERT_EQUAL_UINT32(header_count(allocator.last_block), 1);
+
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint32_t j = 0; j < 6; j++) {
+      TEST_ASSERT_EQUAL_UINT32(allocs[i][j], i);
+    }
+  }
+
+  // Freed slots are reused
+  void *freed = allocs[count / 2];
+  fstd_free(&allocator, freed);
+  allocs[count / 2] = fstd_alloc(&allocator, 17);
+  TEST_ASSERT(allocs[count / 2] == freed);
+
+  // Other sizes get slabs of their own, and bigger ones go to the blocks
+  void *small = fstd_alloc(&allocator, 1);
+  void *big = fstd_alloc(&allocator, FSTD_ALLOC_SLAB_MAX_SIZE + 1);
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 4);
+  TEST_ASSERT_EQUAL_UINT32(header_count(allocator.last_block), 2);
+  fstd_free(&allocator, small);
+  fstd_free(&allocator, big);
+
+  // Empty slabs are kept until trimmed
+  for (uint32_t i = 0; i < count; i++) {
+    fstd_free(&allocator, allocs[i]);
+  }
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 4);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 0);
+
+  // Along with the whole pages of the first block, which `big` was in
+  size_t released = fstd_allocator_trim(&allocator, FSTD_ALLOC_SLAB_SIZE);
+  TEST_ASSERT(released > 3 * FSTD_ALLOC_SLAB_SIZE);
+  TEST_ASSERT(released < 3 * FSTD_ALLOC_SLAB_SIZE + allocator.block_size);
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 1);
+
+  // The first block's pages aren't counted twice
+  TEST_ASSERT_EQUAL_UINT32(
+      fstd_allocator_trim(&allocator, 0), FSTD_ALLOC_SLAB_SIZE);
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 0);
+  TEST_ASSERT_EQUAL_UINT32(fstd_allocator_trim(&allocator, 0), 0);
+
+  free(allocs);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_slab_realloc() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 16;
+  options.slab_max_size = 64;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  uint8_t *alloc = fstd_alloc(&allocator, 20);
+  memset(alloc, 7, 20);
+
+  // Stays in its slot while it fits
+  TEST_ASSERT(fstd_realloc(&allocator, alloc, 32) == alloc);
+  TEST_ASSERT(fstd_realloc(&allocator, alloc, 1) == alloc);
+
+  // Moves to the blocks when it outgrows slabs
+  alloc = fstd_realloc(&allocator, alloc, 200);
+  TEST_ASSERT_EQUAL_UINT32(header_count(allocator.last_block), 2);
+  for (uint32_t i = 0; i < 20; i++) {
+    TEST_ASSERT_EQUAL_UINT8(alloc[i], 7);
+  }
+
+  // Coming back from an alignment a slot can't give
+  uint8_t *aligned = fstd_alloc(&allocator, 48);
+  memset(aligned, 9, 48);
+  aligned = fstd_realloc_aligned(&allocator, aligned, 48, 256);
+  TEST_ASSERT((uintptr_t)aligned % 256 == 0);
+  for (uint32_t i = 0; i < 48; i++) {
+    TEST_ASSERT_EQUAL_UINT8(aligned[i], 9);
+  }
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 2);
+
+  fstd_free(&allocator, alloc);
+  fstd_free(&allocator, aligned);
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_slab_batch() {
+  fstd_allocator_t allocator;
+
+  fstd_allocator_options_t options = {0};
+  options.block_size = 1 << 16;
+  options.slab_max_size = 64;
+  fstd_allocator_init_with_options(&allocator, &options);
+
+  void *allocs[300];
+  TEST_ASSERT_EQUAL_UINT32(fstd_alloc_batch(&allocator, 40, 100, allocs), 100);
+  TEST_ASSERT_EQUAL_UINT32(
+      fstd_alloc_batch(&allocator, 100, 100, allocs + 100), 100);
+  TEST_ASSERT_EQUAL_UINT32(
+      fstd_alloc_batch(&allocator, 8, 100, allocs + 200), 100);
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 2);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 300);
+
+  // Slots and headers mixed in one batch
+  fstd_free_batch(&allocator, allocs, 300);
+
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.live_count, 0);
+  TEST_ASSERT_EQUAL_UINT32(stats.free_count, stats.block_count);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_slab_disabled() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 1 << 16);
+
+  // Zero bytes is no reason to make a slab when slabs are off
+  void *alloc = fstd_alloc(&allocator, 0);
+  TEST_ASSERT(alloc != NULL);
+  void *batch[4];
+  TEST_ASSERT_EQUAL_UINT32(4, fstd_alloc_batch(&allocator, 0, 4, batch));
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slab_count, 0);
+
+  fstd_free(&allocator, alloc);
+  fstd_free_batch(&allocator, batch, 4);
+  fstd_allocator_destroy(&allocator);
+
+  // Heaps find the owner of a pointer from its block
+  fstd_heap_t heap;
+  fstd_heap_init(&heap);
+  alloc = fstd_heap_alloc(&heap, 0);
+  TEST_ASSERT(alloc != NULL);
+  TEST_ASSERT(heap.allocator.slab_count == 0);
+  fstd_heap_free(&heap, alloc);
+  fstd_heap_destroy(&heap);
+}
+
+void test_arena_alloc() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 64);
+
+  uint8_t *alloc1 = fstd_arena_alloc(&arena, 1);
+  uint8_t *alloc2 = fstd_arena_alloc(&arena, 1);
+  TEST_ASSERT(alloc1 != NULL);
+  TEST_ASSERT(alloc2 != NULL);
+  TEST_ASSERT((uintptr_t)alloc2 % FSTD__ALLOC_ALIGNMENT == 0);
+  TEST_ASSERT_EQUAL_PTR(alloc1 + FSTD__ALLOC_ALIGNMENT, alloc2);
+
+  TEST_ASSERT(fstd_arena_alloc(&arena, 64) != NULL);
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 2);
+
+  fstd_arena_destroy(&arena);
+}
+
+void test_arena_alloc_oversized() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 64);
+
+  uint8_t *small = fstd_arena_alloc(&arena, 16);
+  fstd_arena_mark_t mark = fstd_arena_mark(&arena);
+
+  // Too big for any block, so it gets one of its own
+  uint8_t *big = fstd_arena_alloc(&arena, 1000);
+  TEST_ASSERT(big != NULL);
+  memset(big, 1, 1000);
+  TEST_ASSERT_EQUAL_PTR(arena.base_block.next->storage, big);
+  TEST_ASSERT_EQUAL_UINT32(2, arena_block_count(&arena));
+
+  // Which it fills, so the next allocation goes into another
+  uint8_t *after = fstd_arena_alloc(&arena, 16);
+  TEST_ASSERT_EQUAL_PTR(arena.base_block.next->next->storage, after);
+
+  fstd_arena_rollback(&arena, mark);
+  TEST_ASSERT_EQUAL_PTR(small + 16, fstd_arena_alloc(&arena, 16));
+  TEST_ASSERT_EQUAL_PTR(big, fstd_arena_alloc(&arena, 1000));
+  TEST_ASSERT_EQUAL_PTR(after, fstd_arena_alloc(&arena, 16));
+  TEST_ASSERT_EQUAL_UINT32(3, arena_block_count(&arena));
+
+  // A block left over too small for it is kept after the new one
+  fstd_arena_reset(&arena);
+  TEST_ASSERT_EQUAL_PTR(small, fstd_arena_alloc(&arena, 64));
+  TEST_ASSERT_EQUAL_PTR(big, fstd_arena_alloc(&arena, 64));
+  uint8_t *bigger = fstd_arena_alloc(&arena, 2000);
+  TEST_ASSERT(bigger != NULL);
+  memset(bigger, 2, 2000);
+  TEST_ASSERT_EQUAL_UINT32(4, arena_block_count(&arena));
+  TEST_ASSERT_EQUAL_PTR(arena.base_block.next->next->storage, bigger);
+  TEST_ASSERT_EQUAL_PTR(after, fstd_arena_alloc(&arena, 16));
+
+  fstd_arena_destroy(&arena);
+}
+
+void test_arena_rollback() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 64);
+
+  uint32_t *outer = fstd_arena_alloc(&arena, sizeof(uint32_t));
+  *outer = 42;
+
+  fstd_arena_mark_t mark = fstd_arena_mark(&arena);
+  void *inner1 = fstd_arena_alloc(&arena, 48);
+  TEST_ASSERT(fstd_arena_alloc(&arena, 48) != NULL);
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 2);
+
+  fstd_arena_rollback(&arena, mark);
+
+  // Same memory is handed out again and no block is released
+  TEST_ASSERT_EQUAL_PTR(inner1, fstd_arena_alloc(&arena, 48));
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 2);
+  TEST_ASSERT_EQUAL_UINT32(*outer, 42);
+
+  fstd_arena_destroy(&arena);
+}
+
+void test_arena_reset() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 64);
+
+  void *first = fstd_arena_alloc(&arena, 64);
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT(fstd_arena_alloc(&arena, 64) != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 5);
+
+  fstd_arena_reset(&arena);
+
+  TEST_ASSERT_EQUAL_PTR(first, fstd_arena_alloc(&arena, 64));
+  for (uint32_t i = 0; i < 4; i++) {
+    TEST_ASSERT(fstd_arena_alloc(&arena, 64) != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 5);
+
+  fstd_arena_destroy(&arena);
+}
+
+void test_arena_interface() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 64);
+  fstd_alloc_interface_t interface = fstd_alloc_interface_arena(&arena);
+
+  uint8_t *ptr = interface.alloc(interface.ctx, 8);
+  memset(ptr, 7, 8);
+
+  // The latest allocation grows in place while the block has room
+  TEST_ASSERT_EQUAL_PTR(ptr, interface.realloc(interface.ctx, ptr, 8, 48));
+
+  uint8_t *other = interface.alloc(interface.ctx, 8);
+  TEST_ASSERT_EQUAL_PTR(ptr + 48, other);
+
+  // Anything else is copied
+  uint8_t *moved = interface.realloc(interface.ctx, ptr, 48, 56);
+  TEST_ASSERT(moved != ptr);
+  TEST_ASSERT_EACH_EQUAL_UINT8(7, moved, 8);
+  TEST_ASSERT_EQUAL_UINT32(arena_block_count(&arena), 2);
+
+  interface.free(interface.ctx, moved, 56);
+  fstd_arena_destroy(&arena);
+}
+
+void test_stack_frames() {
+  fstd_stack_allocator_t stack;
+  fstd_stack_allocator_init(&stack, 256);
+
+  uint8_t *outer = fstd_stack_alloc(&stack, 16);
+  fstd_stack_push_frame(&stack);
+  uint8_t *inner = fstd_stack_alloc(&stack, 64);
+
+  fstd_stack_push_frame(&stack);
+  for (uint32_t i = 0; i < 8; i++) {
+    TEST_ASSERT(fstd_stack_alloc(&stack, 100) != NULL);
+  }
+  TEST_ASSERT_EQUAL_UINT32(5, arena_block_count(&stack.arena));
+  fstd_stack_pop_frame(&stack);
+
+  // Back to right after `inner`
+  TEST_ASSERT_EQUAL_PTR(inner + 64, fstd_stack_alloc(&stack, 16));
+
+  fstd_stack_pop_frame(&stack);
+  TEST_ASSERT_NULL(stack.frame);
+  TEST_ASSERT_EQUAL_PTR(outer + 16, fstd_stack_alloc(&stack, 16));
+
+  // Blocks are kept for the next frames
+  TEST_ASSERT_EQUAL_UINT32(5, arena_block_count(&stack.arena));
+
+  fstd_stack_allocator_destroy(&stack);
+}
+
+void test_stack_frames_tiny_blocks() {
+  fstd_stack_allocator_t stack;
+  fstd_stack_allocator_init(&stack, 8);
+
+  // Frames don't fit in a block, so each gets one of its own
+  TEST_ASSERT(fstd_stack_push_frame(&stack));
+  uint8_t *ptr = fstd_stack_alloc(&stack, 8);
+  TEST_ASSERT(ptr != NULL);
+  TEST_ASSERT(fstd_stack_push_frame(&stack));
+  TEST_ASSERT(fstd_stack_alloc(&stack, 8) != NULL);
+  fstd_stack_pop_frame(&stack);
+
+  TEST_ASSERT(stack.frame != NULL);
+  fstd_stack_pop_frame(&stack);
+  TEST_ASSERT_NULL(stack.frame);
+
+  fstd_stack_allocator_destroy(&stack);
+}
+
+void test_stack_free() {
+  fstd_stack_allocator_t stack;
+  fstd_stack_allocator_init(&stack, 64);
+
+  uint8_t *ptr1 = fstd_stack_alloc(&stack, 40);
+  uint8_t *ptr2 = fstd_stack_alloc(&stack, 8);
+  // Doesn't fit, so it goes into the next block
+  uint8_t *ptr3 = fstd_stack_alloc(&stack, 32);
+  TEST_ASSERT_EQUAL_PTR(stack.arena.base_block.next->storage, ptr3);
+
+  fstd_stack_free(&stack, ptr3);
+  fstd_stack_free(&stack, ptr2);
+  TEST_ASSERT_EQUAL_PTR(&stack.arena.base_block, stack.arena.current_block);
+  TEST_ASSERT_EQUAL_PTR(ptr2, fstd_stack_alloc(&stack, 8));
+
+  fstd_stack_free(&stack, ptr2);
+  fstd_stack_free(&stack, ptr1);
+  TEST_ASSERT_EQUAL_PTR(ptr1, fstd_stack_alloc(&stack, 64));
+
+  fstd_stack_allocator_destroy(&stack);
+}
+
+void test_stack_interface() {
+  fstd_stack_allocator_t stack;
+  fstd_stack_allocator_init(&stack, 256);
+  fstd_alloc_interface_t interface = fstd_alloc_interface_stack(&stack);
+
+  uint8_t *ptr1 = interface.alloc(interface.ctx, 20);
+  uint8_t *ptr2 = interface.alloc(interface.ctx, 20);
+  uint8_t *ptr3 = interface.alloc(interface.ctx, 20);
+
+  // Not the topmost, so nothing happens
+  interface.free(interface.ctx, ptr2, 20);
+  TEST_ASSERT_EQUAL_PTR(ptr3 + 32, interface.alloc(interface.ctx, 20));
+  interface.free(interface.ctx, ptr3 + 32, 20);
+
+  interface.free(interface.ctx, ptr3, 20);
+  interface.free(interface.ctx, ptr2, 20);
+  TEST_ASSERT_EQUAL_PTR(ptr2, interface.alloc(interface.ctx, 20));
+
+  // Allocations from before the innermost frame stay
+  fstd_stack_push_frame(&stack);
+  interface.free(interface.ctx, ptr2, 20);
+  TEST_ASSERT(interface.alloc(interface.ctx, 20) > (void *)ptr2);
+  fstd_stack_pop_frame(&stack);
+
+  interface.free(interface.ctx, ptr2, 20);
+  interface.free(interface.ctx, ptr1, 20);
+  TEST_ASSERT_EQUAL_PTR(ptr1, interface.alloc(interface.ctx, 20));
+
+  // Steps back into the previous block once the current one is empty, but
+  // only for its topmost allocation
+  uint8_t *last = interface.alloc(interface.ctx, 200);
+  uint8_t *next = interface.alloc(interface.ctx, 100);
+  TEST_ASSERT_EQUAL_PTR(stack.arena.base_block.next->storage, next);
+  interface.free(interface.ctx, next, 100);
+  interface.free(interface.ctx, ptr1, 20);
+  TEST_ASSERT_EQUAL_PTR(stack.arena.base_block.next, stack.arena.current_block);
+  interface.free(interface.ctx, last, 200);
+  TEST_ASSERT_EQUAL_PTR(last, interface.alloc(interface.ctx, 200));
+
+  fstd_stack_allocator_destroy(&stack);
+}
+
 int main() {
   UNITY_BEGIN();
 
@@ -230,9 +1313,41 @@ int main() {
   RUN_TEST(test_alloc_aligned);
   RUN_TEST(test_alloc_multi_block);
   RUN_TEST(test_alloc_too_big);
+  RUN_TEST(test_alloc_large_realloc);
+  RUN_TEST(test_alloc_aligned_custom);
+  RUN_TEST(test_alloc_realloc_aligned);
+  RUN_TEST(test_alloc_realloc_aligned_large);
   RUN_TEST(test_alloc_free);
   RUN_TEST(test_alloc_realloc_grow);
   RUN_TEST(test_alloc_realloc_fragmented);
+  RUN_TEST(test_alloc_realloc_shrink);
+  RUN_TEST(test_alloc_realloc_backward);
+  RUN_TEST(test_alloc_reuse_freed);
+  RUN_TEST(test_alloc_batch);
+  RUN_TEST(test_alloc_tlsf);
+  RUN_TEST(test_alloc_fit_policies);
+  RUN_TEST(test_alloc_trim);
+  RUN_TEST(test_alloc_decommit);
+  RUN_TEST(test_alloc_mapped_storage);
+  RUN_TEST(test_alloc_growth);
+  RUN_TEST(test_alloc_many_blocks);
+  RUN_TEST(test_alloc_aligned_blocks);
+  RUN_TEST(test_alloc_stats);
+  RUN_TEST(test_slab_alloc);
+  RUN_TEST(test_slab_realloc);
+  RUN_TEST(test_slab_batch);
+  RUN_TEST(test_heap_remote_free);
+  RUN_TEST(test_heap_threads);
+  RUN_TEST(test_slab_disabled);
+  RUN_TEST(test_arena_alloc);
+  RUN_TEST(test_arena_alloc_oversized);
+  RUN_TEST(test_arena_rollback);
+  RUN_TEST(test_arena_reset);
+  RUN_TEST(test_arena_interface);
+  RUN_TEST(test_stack_frames);
+  RUN_TEST(test_stack_frames_tiny_blocks);
+  RUN_TEST(test_stack_free);
+  RUN_TEST(test_stack_interface);
 
   return UNITY_END();
 }
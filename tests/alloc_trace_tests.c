@@ -0,0 +1,137 @@
+// Built on its own, as FSTD_ALLOC_TRACE changes fstd_allocator_t
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#define FSTD_ALLOC_TRACE
+#define FSTD_ALLOC_IMPLEMENTATION
+#include <fstd_alloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unity.h>
+
+static size_t read_trace(
+    FILE *file, fstd_alloc_trace_record_t *records, size_t max_count) {
+  long size = ftell(file);
+  uint8_t *data = malloc((size_t)size);
+  rewind(file);
+  TEST_ASSERT_EQUAL(size, fread(data, 1, (size_t)size, file));
+  TEST_ASSERT_EQUAL_MEMORY(
+      FSTD_ALLOC_TRACE_MAGIC, data, FSTD_ALLOC_TRACE_MAGIC_SIZE);
+
+  const uint8_t *cursor = data + FSTD_ALLOC_TRACE_MAGIC_SIZE;
+  size_t count = 0;
+  while (count < max_count &&
+         fstd_alloc_trace_read(&cursor, data + size, &records[count])) {
+    count++;
+  }
+  TEST_ASSERT_EQUAL_PTR(data + size, cursor);
+
+  free(data);
+  return count;
+}
+
+void test_trace_records() {
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+  fstd_allocator_trace(&allocator, file);
+
+  void *ptr1 = fstd_alloc(&allocator, 100);
+  void *ptr2 = fstd_alloc_aligned(&allocator, 64, 256);
+  // Moves, which allocates and frees inside fstd_realloc
+  void *ptr3 = fstd_realloc(&allocator, ptr1, 10000);
+  fstd_free(&allocator, ptr2);
+  fstd_free(&allocator, ptr3);
+
+  fstd_allocator_trace(&allocator, NULL);
+  fstd_free(&allocator, fstd_alloc(&allocator, 16));
+
+  fstd_alloc_trace_record_t records[8];
+  TEST_ASSERT_EQUAL(5, read_trace(file, records, 8));
+
+  TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_ALLOC, records[0].op);
+  TEST_ASSERT_EQUAL_UINT64(100, records[0].size);
+  TEST_ASSERT_EQUAL_UINT64(16, records[0].align);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr1, records[0].ptr);
+
+  TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_ALLOC, records[1].op);
+  TEST_ASSERT_EQUAL_UINT64(256, records[1].align);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr2, records[1].ptr);
+
+  TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_REALLOC, records[2].op);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr1, records[2].old_ptr);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr3, records[2].ptr);
+  TEST_ASSERT_EQUAL_UINT64(10000, records[2].size);
+
+  TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_FREE, records[3].op);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr2, records[3].ptr);
+  TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_FREE, records[4].op);
+  TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptr3, records[4].ptr);
+
+  fstd_allocator_destroy(&allocator);
+  fclose(file);
+}
+
+void test_trace_batch() {
+  FILE *file = tmpfile();
+  TEST_ASSERT_NOT_NULL(file);
+
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+  fstd_allocator_trace(&allocator, file);
+
+  void *ptrs[4];
+  TEST_ASSERT_EQUAL(4, fstd_alloc_batch(&allocator, 32, 4, ptrs));
+  fstd_free_batch(&allocator, ptrs, 4);
+
+  fstd_alloc_trace_record_t records[16];
+  TEST_ASSERT_EQUAL(8, read_trace(file, records, 16));
+  for (size_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_ALLOC, records[i].op);
+    TEST_ASSERT_EQUAL_UINT64(32, records[i].size);
+    TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptrs[i], records[i].ptr);
+    TEST_ASSERT_EQUAL(FSTD_ALLOC_TRACE_FREE, records[4 + i].op);
+    TEST_ASSERT_EQUAL_UINT64((uintptr_t)ptrs[i], records[4 + i].ptr);
+  }
+
+  fstd_allocator_destroy(&allocator);
+  fclose(file);
+}
+
+void test_trace_truncated() {
+  uint8_t data[16];
+  uint8_t *end = data;
+  *end++ = FSTD_ALLOC_TRACE_ALLOC;
+  *end++ = 5; // time
+  *end++ = 0x80 | 0x10; // size, 400
+  *end++ = 0x03;
+  *end++ = 4; // log2(align)
+
+  fstd_alloc_trace_record_t record;
+  const uint8_t *cursor = data;
+  TEST_ASSERT_FALSE(fstd_alloc_trace_read(&cursor, end, &record));
+  TEST_ASSERT_EQUAL_PTR(data, cursor);
+
+  *end++ = 0x01; // ptr, 16
+  TEST_ASSERT_TRUE(fstd_alloc_trace_read(&cursor, end, &record));
+  TEST_ASSERT_EQUAL_UINT64(5, record.time);
+  TEST_ASSERT_EQUAL_UINT64(400, record.size);
+  TEST_ASSERT_EQUAL_UINT64(16, record.align);
+  TEST_ASSERT_EQUAL_UINT64(16, record.ptr);
+  TEST_ASSERT_EQUAL_PTR(end, cursor);
+  TEST_ASSERT_FALSE(fstd_alloc_trace_read(&cursor, end, &record));
+}
+
+int main() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_trace_records);
+  RUN_TEST(test_trace_batch);
+  RUN_TEST(test_trace_truncated);
+
+  return UNITY_END();
+}
@@ -23,11 +23,38 @@ void test_bitset_set() {
   TEST_ASSERT_EQUAL(fstd_bitset_at(&bitset, 35), true);
 }
 
+void test_bitset_find_zero() {
+  FSTD_BITSET(200) bitset;
+  fstd_bitset_reset(&bitset, 200);
+  TEST_ASSERT_EQUAL_UINT32(0, fstd_bitset_find_zero(&bitset, 0, 200));
+  TEST_ASSERT_EQUAL_UINT32(13, fstd_bitset_find_zero(&bitset, 13, 200));
+
+  for (uint32_t i = 0; i < 150; i++) {
+    fstd_bitset_set(&bitset, i, true);
+  }
+  TEST_ASSERT_EQUAL_UINT32(150, fstd_bitset_find_zero(&bitset, 0, 200));
+  TEST_ASSERT_EQUAL_UINT32(150, fstd_bitset_find_zero(&bitset, 70, 200));
+
+  fstd_bitset_set(&bitset, 64, false);
+  TEST_ASSERT_EQUAL_UINT32(64, fstd_bitset_find_zero(&bitset, 3, 200));
+  TEST_ASSERT_EQUAL_UINT32(150, fstd_bitset_find_zero(&bitset, 65, 200));
+
+  // Nothing past the size is looked at
+  for (uint32_t i = 150; i < 200; i++) {
+    fstd_bitset_set(&bitset, i, true);
+  }
+  TEST_ASSERT_EQUAL_UINT32(200, fstd_bitset_find_zero(&bitset, 65, 200));
+  fstd_bitset_set(&bitset, 199, false);
+  TEST_ASSERT_EQUAL_UINT32(197, fstd_bitset_find_zero(&bitset, 65, 197));
+  TEST_ASSERT_EQUAL_UINT32(199, fstd_bitset_find_zero(&bitset, 65, 200));
+}
+
 int main() {
   UNITY_BEGIN();
 
   RUN_TEST(test_bitset_size);
   RUN_TEST(test_bitset_set);
+  RUN_TEST(test_bitset_find_zero);
 
   return UNITY_END();
 }
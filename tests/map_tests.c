@@ -1,4 +1,5 @@
 #include <fstd_map.h>
+#include <stdio.h>
 #include <string.h>
 #include <unity.h>
 
@@ -74,6 +75,7 @@ void test_map_remove_nonexistant() {
 void test_map_capacity() {
   fstd_map_t map;
   fstd_map_init(&map, 2, int);
+  map.max_load = 1.0f;
 
   int *elem1 = fstd_map_set(&map, "Hello", &(int){1});
   TEST_ASSERT_NOT_NULL(elem1);
@@ -95,6 +97,7 @@ void test_map_capacity() {
 void test_map_collision() {
   fstd_map_t map;
   fstd_map_init(&map, 3, int);
+  map.hash_fn = fstd_map_djb_hash;
 
   size_t hash1 = fstd__djb_hash("Hey") % map.capacity;
   size_t hash2 = fstd__djb_hash("World") % map.capacity;
@@ -123,8 +126,10 @@ void test_map_read_key_from_index() {
 
   fstd_map_set(&map, "Hey", &(int){1});
 
-  char *key;
-  TEST_ASSERT(fstd_map_get_by_index(&map, 0, &key));
+  char *key = NULL;
+  for (size_t i = 0; i < map.capacity && key == NULL; i++) {
+    fstd_map_get_by_index(&map, i, &key);
+  }
   TEST_ASSERT_EQUAL_STRING("Hey", key);
 
   fstd_map_destroy(&map);
@@ -142,6 +147,454 @@ void test_map_read_key_from_value() {
   fstd_map_destroy(&map);
 }
 
+void test_map_grow() {
+  fstd_map_t map;
+  fstd_map_init(&map, 1, int);
+
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+    TEST_ASSERT((float)map.filled <= (float)map.capacity * map.max_load);
+  }
+  TEST_ASSERT_EQUAL(1000, map.filled);
+
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    int *value = fstd_map_get(&map, key);
+    TEST_ASSERT_NOT_NULL(value);
+    TEST_ASSERT_EQUAL(i, *value);
+  }
+  TEST_ASSERT_NULL(fstd_map_get(&map, "missing"));
+
+  fstd_map_destroy(&map);
+}
+
+void test_map_rehash_deleted() {
+  fstd_map_t map;
+  fstd_map_init(&map, 16, int);
+
+  // Keys that are removed right away only leave deleted bundles behind,
+  // which rehashing gets rid of without growing
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+    TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, key));
+  }
+  TEST_ASSERT_EQUAL(16, map.capacity);
+  TEST_ASSERT_EQUAL(0, map.filled);
+  TEST_ASSERT(map.deleted < map.capacity);
+
+  fstd_map_destroy(&map);
+}
+
+void test_map_shrink() {
+  fstd_map_t map;
+  fstd_map_init(&map, 8, int);
+  map.min_load = 0.25f;
+
+  char key[16];
+  for (int i = 0; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    fstd_map_set(&map, key, &i);
+  }
+  size_t capacity = map.capacity;
+
+  for (int i = 1; i < 100; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    fstd_map_remove(&map, key);
+  }
+
+  // Shrinking happens when the next key is added, down to the initial
+  // capacity
+  TEST_ASSERT_EQUAL(capacity, map.capacity);
+  fstd_map_set(&map, "key100", &(int){100});
+  TEST_ASSERT_EQUAL(8, map.capacity);
+  TEST_ASSERT_EQUAL(0, *(int *)fstd_map_get(&map, "key0"));
+  TEST_ASSERT_EQUAL(100, *(int *)fstd_map_get(&map, "key100"));
+
+  fstd_map_destroy(&map);
+}
+
+void test_map_zero_capacity() {
+  fstd_map_t map;
+  fstd_map_init(&map, 0, int);
+  map.min_load = 0.5f;
+
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key"));
+  TEST_ASSERT_NULL(fstd_map_remove(&map, "key"));
+
+  char key[16];
+  for (int i = 0; i < 8; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    fstd_map_set(&map, key, &i);
+  }
+  for (int i = 0; i < 8; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    fstd_map_remove(&map, key);
+  }
+
+  // Rehashed to get rid of the deleted bundles, then emptied again and
+  // shrunk as far as it goes by the next key
+  fstd_map_set(&map, "key0", &(int){0});
+  fstd_map_remove(&map, "key0");
+  fstd_map_set(&map, "other", &(int){8});
+  TEST_ASSERT_EQUAL(1, map.capacity);
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key0"));
+  TEST_ASSERT_NULL(fstd_map_remove(&map, "key0"));
+  TEST_ASSERT_EQUAL(8, *(int *)fstd_map_get(&map, "other"));
+
+  fstd_map_destroy(&map);
+
+  // Fixed at 0, so nothing can be added
+  fstd_map_init(&map, 0, int);
+  map.max_load = 1.0f;
+  TEST_ASSERT_NULL(fstd_map_set(&map, "key", &(int){1}));
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key"));
+  TEST_ASSERT_NULL(fstd_map_remove(&map, "key"));
+  fstd_map_destroy(&map);
+}
+
+void test_map_incremental_rehash() {
+  fstd_map_t map;
+  fstd_map_init(&map, 16, int);
+  map.rehash_step = 2;
+
+  char key[16];
+  bool rehashing = false;
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+    rehashing |= map.old_bundles != NULL;
+
+    // Everything stays reachable while bundles are being moved
+    for (int j = 0; j <= i; j += 37) {
+      snprintf(key, sizeof(key), "key%d", j);
+      int *value = fstd_map_get(&map, key);
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL(j, *value);
+    }
+  }
+  TEST_ASSERT(rehashing);
+  TEST_ASSERT_EQUAL(1000, map.filled);
+
+  // Removing and setting keys still in the old bundles
+  while (map.old_bundles == NULL) {
+    snprintf(key, sizeof(key), "key%d", (int)map.filled);
+    fstd_map_set(&map, key, &(int){0});
+  }
+  for (int i = 0; i < 500; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, key));
+    TEST_ASSERT_NULL(fstd_map_get(&map, key));
+  }
+  for (int i = 500; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &(int){-i}));
+    TEST_ASSERT_EQUAL(-i, *(int *)fstd_map_get(&map, key));
+  }
+
+  // Destroying frees whatever hasn't been moved yet
+  fstd_map_destroy(&map);
+}
+
+void test_map_grouped() {
+  fstd_map_t map;
+  fstd_map_init_grouped(&map, 20, int);
+  TEST_ASSERT(map.grouped);
+  TEST_ASSERT_EQUAL(0, map.capacity & (map.capacity - 1));
+  TEST_ASSERT(map.capacity >= 20);
+
+  char key[16];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+  }
+  TEST_ASSERT_EQUAL(1000, map.filled);
+  TEST_ASSERT_EQUAL(0, map.capacity & (map.capacity - 1));
+
+  for (int i = 0; i < 1000; i += 2) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, key));
+  }
+  for (int i = 0; i < 1000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    int *value = fstd_map_get(&map, key);
+    if (i % 2 == 0) {
+      TEST_ASSERT_NULL(value);
+    } else {
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL(i, *value);
+    }
+  }
+
+  // Removed keys can be set again
+  for (int i = 0; i < 1000; i += 2) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &(int){-i}));
+    TEST_ASSERT_EQUAL(-i, *(int *)fstd_map_get(&map, key));
+  }
+  TEST_ASSERT_EQUAL(1000, map.filled);
+
+  size_t found = 0;
+  for (size_t i = 0; i < map.capacity; i++) {
+    char *index_key;
+    int *value = fstd_map_get_by_index(&map, i, &index_key);
+    if (value != NULL) {
+      TEST_ASSERT_EQUAL_PTR(value, fstd_map_get(&map, index_key));
+      found++;
+    }
+  }
+  TEST_ASSERT_EQUAL(1000, found);
+
+  fstd_map_destroy(&map);
+}
+
+void test_map_grouped_full() {
+  fstd_map_t map;
+  fstd_map_init_grouped(&map, 1, int);
+  map.max_load = 1.0f;
+  size_t capacity = map.capacity;
+
+  // Every bundle can be filled, and probes still end once none are empty
+  char key[16];
+  for (int i = 0; i < (int)capacity; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+  }
+  TEST_ASSERT_NULL(fstd_map_set(&map, "one more", &(int){0}));
+  TEST_ASSERT_NULL(fstd_map_get(&map, "one more"));
+  for (int i = 0; i < (int)capacity; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_EQUAL(i, *(int *)fstd_map_get(&map, key));
+  }
+
+  TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, "key0"));
+  TEST_ASSERT_NOT_NULL(fstd_map_set(&map, "one more", &(int){0}));
+  TEST_ASSERT_EQUAL(capacity, map.capacity);
+
+  fstd_map_destroy(&map);
+}
+
+void test_map_grouped_incremental_rehash() {
+  fstd_map_t map;
+  fstd_map_init_grouped(&map, 16, int);
+  map.rehash_step = 3;
+  map.min_load = 0.2f;
+
+  char key[16];
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 2000; i++) {
+      snprintf(key, sizeof(key), "key%d", i);
+      TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &(int){i + round}));
+    }
+    for (int i = 0; i < 2000; i++) {
+      snprintf(key, sizeof(key), "key%d", i);
+      int *value = fstd_map_get(&map, key);
+      TEST_ASSERT_NOT_NULL(value);
+      TEST_ASSERT_EQUAL(i + round, *value);
+    }
+    for (int i = 0; i < 1990; i++) {
+      snprintf(key, sizeof(key), "key%d", i);
+      TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, key));
+    }
+    TEST_ASSERT_EQUAL(10, map.filled);
+  }
+
+  fstd_map_destroy(&map);
+}
+
+static uint64_t constant_hash(const char *key, uint64_t seed) {
+  (void)key;
+  (void)seed;
+  return 42;
+}
+
+void test_map_hash_fn() {
+  // Every key colliding still works, just slowly
+  for (int grouped = 0; grouped < 2; grouped++) {
+    fstd_map_t map;
+    if (grouped) {
+      fstd_map_init_grouped(&map, 1, int);
+    } else {
+      fstd_map_init(&map, 1, int);
+    }
+    map.hash_fn = constant_hash;
+
+    char key[16];
+    for (int i = 0; i < 200; i++) {
+      snprintf(key, sizeof(key), "key%d", i);
+      TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+    }
+    for (int i = 0; i < 200; i += 3) {
+      snprintf(key, sizeof(key), "key%d", i);
+      TEST_ASSERT_NOT_NULL(fstd_map_remove(&map, key));
+    }
+    for (int i = 0; i < 200; i++) {
+      snprintf(key, sizeof(key), "key%d", i);
+      int *value = fstd_map_get(&map, key);
+      if (i % 3 == 0) {
+        TEST_ASSERT_NULL(value);
+      } else {
+        TEST_ASSERT_NOT_NULL(value);
+        TEST_ASSERT_EQUAL(i, *value);
+      }
+    }
+
+    fstd_map_destroy(&map);
+  }
+}
+
+void test_map_seed() {
+  fstd_map_t map1, map2;
+  fstd_map_init(&map1, 16, int);
+  fstd_map_init(&map2, 16, int);
+  TEST_ASSERT(map1.seed != map2.seed);
+
+  TEST_ASSERT_EQUAL_UINT64(
+      fstd_map_wyhash("Hello", 1), fstd_map_wyhash("Hello", 1));
+  TEST_ASSERT(fstd_map_wyhash("Hello", 1) != fstd_map_wyhash("Hello", 2));
+  TEST_ASSERT(fstd_map_wyhash("Hello", 1) != fstd_map_wyhash("Hellp", 1));
+
+  // Every key length takes a different path through the hash
+  char key[128];
+  uint64_t hashes[sizeof(key)];
+  for (size_t length = 0; length < sizeof(key); length++) {
+    memset(key, 'a', length);
+    key[length] = '\0';
+    hashes[length] = fstd_map_wyhash(key, 7);
+    for (size_t i = 0; i < length; i++) {
+      TEST_ASSERT(hashes[i] != hashes[length]);
+    }
+  }
+
+  fstd_map_destroy(&map1);
+  fstd_map_destroy(&map2);
+}
+
+void test_map_allocator() {
+  fstd_allocator_t allocator;
+  fstd_allocator_init(&allocator, 4096);
+
+  fstd_map_t map;
+  fstd_map_init_with_allocator(
+      &map, 16, int, fstd_alloc_interface_allocator(&allocator));
+
+  fstd_map_set(&map, "Hello", &(int){1});
+  fstd_map_set(&map, "World", &(int){2});
+  fstd_map_set(&map, "Hello", &(int){3});
+  fstd_map_remove(&map, "World");
+
+  fstd_allocator_stats_t stats;
+  fstd_allocator_stats(&allocator, &stats);
+  // The bundles and one key
+  TEST_ASSERT_EQUAL_UINT64(2, stats.live_count);
+  TEST_ASSERT_EQUAL(3, *(int *)fstd_map_get(&map, "Hello"));
+
+  fstd_map_destroy(&map);
+
+  fstd_allocator_stats(&allocator, &stats);
+  TEST_ASSERT_EQUAL_UINT64(0, stats.live_count);
+
+  fstd_allocator_destroy(&allocator);
+}
+
+void test_map_arena() {
+  fstd_arena_t arena;
+  fstd_arena_init(&arena, 4096);
+
+  // The bundles soon outgrow the arena's blocks
+  fstd_map_t map;
+  fstd_map_init_with_allocator(
+      &map, 16, int, fstd_alloc_interface_arena(&arena));
+
+  char key[16];
+  for (int i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+  }
+  TEST_ASSERT(map.capacity * map.max_load >= 2000);
+  for (int i = 0; i < 2000; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_EQUAL(i, *(int *)fstd_map_get(&map, key));
+  }
+
+  // No fstd_map_destroy: the arena owns everything
+  fstd_arena_reset(&arena);
+
+  fstd_map_init_with_allocator(
+      &map, 1000, int, fstd_alloc_interface_arena(&arena));
+  TEST_ASSERT_EQUAL(1000, map.capacity);
+  TEST_ASSERT_NOT_NULL(fstd_map_set(&map, "key", &(int){1}));
+
+  fstd_arena_destroy(&arena);
+}
+
+// Fails any allocation bigger than its limit
+static void *limited_alloc(void *ctx, size_t size) {
+  return size > *(size_t *)ctx ? NULL : malloc(size);
+}
+
+static void *
+limited_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size) {
+  (void)old_size;
+  return new_size > *(size_t *)ctx ? NULL : realloc(ptr, new_size);
+}
+
+static void limited_free(void *ctx, void *ptr, size_t size) {
+  (void)ctx;
+  (void)size;
+  free(ptr);
+}
+
+void test_map_failing_allocator() {
+  size_t limit = 0;
+  fstd_alloc_interface_t allocator = {
+      limited_alloc, limited_realloc, limited_free, &limit};
+
+  fstd_map_t map;
+  fstd_map_init_with_allocator(&map, 1000, int, allocator);
+  TEST_ASSERT_EQUAL(0, map.capacity);
+
+  // Room for 8 bundles, but not 16
+  limit = 8 * map.bundle_size;
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key0"));
+  TEST_ASSERT_NULL(fstd_map_remove(&map, "key0"));
+
+  // Sets fail once growing does, instead of going past max_load
+  char key[16];
+  for (int i = 0; i < 6; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_NOT_NULL(fstd_map_set(&map, key, &i));
+  }
+  TEST_ASSERT_EQUAL(8, map.capacity);
+  TEST_ASSERT_NULL(fstd_map_set(&map, "key6", &(int){6}));
+  TEST_ASSERT_EQUAL(8, map.capacity);
+  TEST_ASSERT_EQUAL(6, map.filled);
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key6"));
+  for (int i = 0; i < 6; i++) {
+    snprintf(key, sizeof(key), "key%d", i);
+    TEST_ASSERT_EQUAL(i, *(int *)fstd_map_get(&map, key));
+  }
+
+  // Existing keys can still be set
+  TEST_ASSERT_NOT_NULL(fstd_map_set(&map, "key0", &(int){10}));
+  TEST_ASSERT_EQUAL(10, *(int *)fstd_map_get(&map, "key0"));
+
+  fstd_map_destroy(&map);
+
+  // Grouped maps start from a whole group
+  limit = 1000;
+  fstd_map_init_grouped_with_allocator(&map, 1000, int, allocator);
+  TEST_ASSERT_EQUAL(0, map.capacity);
+  TEST_ASSERT_NULL(fstd_map_get(&map, "key0"));
+  TEST_ASSERT_NOT_NULL(fstd_map_set(&map, "key0", &(int){0}));
+  TEST_ASSERT(map.capacity >= 16);
+  TEST_ASSERT_EQUAL(0, *(int *)fstd_map_get(&map, "key0"));
+  fstd_map_destroy(&map);
+}
+
 int main() {
   UNITY_BEGIN();
 
@@ -153,6 +606,19 @@ int main() {
   RUN_TEST(test_map_collision);
   RUN_TEST(test_map_read_key_from_index);
   RUN_TEST(test_map_read_key_from_value);
+  RUN_TEST(test_map_grow);
+  RUN_TEST(test_map_rehash_deleted);
+  RUN_TEST(test_map_shrink);
+  RUN_TEST(test_map_zero_capacity);
+  RUN_TEST(test_map_incremental_rehash);
+  RUN_TEST(test_map_grouped);
+  RUN_TEST(test_map_grouped_full);
+  RUN_TEST(test_map_grouped_incremental_rehash);
+  RUN_TEST(test_map_hash_fn);
+  RUN_TEST(test_map_seed);
+  RUN_TEST(test_map_allocator);
+  RUN_TEST(test_map_arena);
+  RUN_TEST(test_map_failing_allocator);
 
   return UNITY_END();
 }
@@ -0,0 +1,105 @@
+#include <fstd_pool.h>
+#include <unity.h>
+
+typedef struct node_t {
+  struct node_t *next;
+  uint32_t value;
+} node_t;
+
+void test_pool_create_destroy() {
+  fstd_pool_t pool;
+  fstd_pool_init(&pool, sizeof(node_t), 8);
+
+  fstd_pool_stats_t stats;
+  fstd_pool_stats(&pool, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.chunk_count, 0);
+  TEST_ASSERT_EQUAL_UINT32(stats.used_count, 0);
+
+  fstd_pool_destroy(&pool);
+}
+
+void test_pool_alloc_free() {
+  fstd_pool_t pool;
+  fstd_pool_init(&pool, sizeof(node_t), 8);
+
+  node_t *node1 = fstd_pool_alloc(&pool);
+  node_t *node2 = fstd_pool_alloc(&pool);
+  TEST_ASSERT(node1 != NULL);
+  TEST_ASSERT(node2 != NULL);
+  TEST_ASSERT(node1 != node2);
+  node1->value = 1;
+  node2->value = 2;
+
+  fstd_pool_free(&pool, node1);
+
+  // Freed slots are reused first
+  node_t *node3 = fstd_pool_alloc(&pool);
+  TEST_ASSERT_EQUAL_PTR(node1, node3);
+  TEST_ASSERT_EQUAL_UINT32(node2->value, 2);
+
+  fstd_pool_stats_t stats;
+  fstd_pool_stats(&pool, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.chunk_count, 1);
+  TEST_ASSERT_EQUAL_UINT32(stats.slot_count, 8);
+  TEST_ASSERT_EQUAL_UINT32(stats.used_count, 2);
+
+  fstd_pool_destroy(&pool);
+}
+
+void test_pool_alignment() {
+  fstd_pool_t pool;
+
+  fstd_pool_options_t options = {0};
+  options.slot_size = 3;
+  options.alignment = 64;
+  options.chunk_slots = 4;
+  fstd_pool_init_with_options(&pool, &options);
+
+  for (uint32_t i = 0; i < 32; i++) {
+    void *slot = fstd_pool_alloc(&pool);
+    TEST_ASSERT(slot != NULL);
+    TEST_ASSERT((uintptr_t)slot % 64 == 0);
+  }
+
+  fstd_pool_stats_t stats;
+  fstd_pool_stats(&pool, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.slot_size, 64);
+  TEST_ASSERT_EQUAL_UINT32(stats.chunk_count, 8);
+
+  fstd_pool_destroy(&pool);
+}
+
+void test_pool_growth() {
+  fstd_pool_t pool;
+
+  fstd_pool_options_t options = {0};
+  options.slot_size = sizeof(node_t);
+  options.chunk_slots = 4;
+  options.max_chunk_slots = 16;
+  fstd_pool_init_with_options(&pool, &options);
+
+  // Chunks of 4, 8, 16, 16
+  for (uint32_t i = 0; i < 44; i++) {
+    TEST_ASSERT(fstd_pool_alloc(&pool) != NULL);
+  }
+
+  fstd_pool_stats_t stats;
+  fstd_pool_stats(&pool, &stats);
+  TEST_ASSERT_EQUAL_UINT32(stats.chunk_count, 4);
+  TEST_ASSERT_EQUAL_UINT32(stats.slot_count, 44);
+  TEST_ASSERT_EQUAL_UINT32(stats.used_count, 44);
+  TEST_ASSERT(stats.reserved_bytes >= 44 * stats.slot_size);
+
+  fstd_pool_destroy(&pool);
+}
+
+int main() {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_pool_create_destroy);
+  RUN_TEST(test_pool_alloc_free);
+  RUN_TEST(test_pool_alignment);
+  RUN_TEST(test_pool_growth);
+
+  return UNITY_END();
+}